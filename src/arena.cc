@@ -0,0 +1,54 @@
+// Bump allocator for the objects that make up a document.
+
+#include "arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace arena {
+
+// Out-of-line definitions, needed before C++17 since std::min binds them by
+// reference.
+constexpr std::size_t Arena::kMinBlockSize;
+constexpr std::size_t Arena::kMaxBlockSize;
+
+void *Arena::allocate(std::size_t size, std::size_t alignment) {
+  std::size_t padding = -reinterpret_cast<std::uintptr_t>(cursor_) &
+                        (alignment - 1);
+  if (cursor_ == nullptr || padding + size > std::size_t(end_ - cursor_)) {
+    // Oversized objects get a block of their own.
+    std::size_t block_size = std::max(next_block_size_, size + alignment);
+    next_block_size_ = std::min(next_block_size_ * 2, kMaxBlockSize);
+    blocks_.push_back(Block{std::unique_ptr<char[]>(new char[block_size]),
+                            block_size});
+    cursor_ = blocks_.back().data.get();
+    end_ = cursor_ + block_size;
+    stats_.blocks++;
+    padding = -reinterpret_cast<std::uintptr_t>(cursor_) & (alignment - 1);
+  }
+  void *p = cursor_ + padding;
+  cursor_ += padding + size;
+  stats_.bytes += padding + size;
+  return p;
+}
+
+void Arena::reset() {
+  // Destroy objects in the reverse order of their construction.
+  for (Finalizer *f = finalizers_; f != nullptr; f = f->prev) {
+    f->destroy(f->object);
+  }
+  finalizers_ = nullptr;
+  stats_ = Stats();
+  if (blocks_.empty()) {
+    return;
+  }
+  // The most recent block is normally the largest one. Keep it so an arena
+  // that is refilled after a reset doesn't have to allocate again.
+  Block largest = std::move(blocks_.back());
+  blocks_.clear();
+  cursor_ = largest.data.get();
+  end_ = cursor_ + largest.size;
+  blocks_.push_back(std::move(largest));
+  stats_.blocks = 1;
+}
+}  // namespace arena
@@ -0,0 +1,84 @@
+// Bump allocator for the objects that make up a document.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace arena {
+
+// Allocates objects by bumping a pointer through large blocks. Objects are
+// never freed individually: destroying (or resetting) the arena runs their
+// destructors and releases every block at once.
+class Arena {
+  // Placed in front of objects whose destructors need to run.
+  struct Finalizer {
+    Finalizer *prev;
+    void *object;
+    void (*destroy)(void *);
+  };
+
+ public:
+  struct Stats {
+    long objects = 0;
+    long bytes = 0;
+    long blocks = 0;
+  };
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    std::size_t size;
+  };
+  // Blocks start small and double in size, so large documents are held in a
+  // handful of blocks.
+  static constexpr std::size_t kMinBlockSize = 64 * 1024;
+  static constexpr std::size_t kMaxBlockSize = 4 * 1024 * 1024;
+  std::vector<Block> blocks_;
+  std::size_t next_block_size_ = kMinBlockSize;
+  char *cursor_ = nullptr;
+  char *end_ = nullptr;
+  Finalizer *finalizers_ = nullptr;
+  Stats stats_;
+
+  void *allocate(std::size_t size, std::size_t alignment);
+
+ public:
+  Arena(){};
+  // Destroys every object in the arena and releases all of its memory.
+  ~Arena() { reset(); }
+  // Delete copy constructor and copy assignment operator
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Constructs a T in the arena. The arena owns the returned object.
+  template <typename T, typename... Args>
+  T *make(Args &&... args) {
+    stats_.objects++;
+    if (std::is_trivially_destructible<T>::value) {
+      return new (allocate(sizeof(T), alignof(T)))
+          T(std::forward<Args>(args)...);
+    }
+    Finalizer *finalizer = static_cast<Finalizer *>(
+        allocate(sizeof(Finalizer), alignof(Finalizer)));
+    T *object = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+    finalizer->prev = finalizers_;
+    finalizer->object = object;
+    finalizer->destroy = [](void *p) { static_cast<T *>(p)->~T(); };
+    finalizers_ = finalizer;
+    return object;
+  }
+
+  // Destroys every object in the arena and releases all but its largest
+  // block, which is kept for reuse.
+  void reset();
+  const Stats &get_stats() const { return stats_; }
+};
+}  // namespace arena
+
+#endif
@@ -0,0 +1,158 @@
+#include "generator.h"
+
+#include <random>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+
+namespace bench {
+
+namespace {
+
+const char* const kTags[] = {"div", "div", "div", "p",  "span",
+                             "a",   "b",   "em",  "h2", "h3"};
+const int kNumTags = sizeof(kTags) / sizeof(kTags[0]);
+
+const char* const kWords[] = {
+    "lorem",   "ipsum",   "dolor",  "sit",     "amet",     "browser",
+    "engine",  "layout",  "style",  "paint",   "parse",    "toy",
+    "quick",   "brown",   "fox",    "jumps",   "over",     "lazy",
+    "dog",     "render",  "pixel",  "tree",    "node",     "cascade",
+    "selector", "box",    "inline", "block",   "margin",   "padding",
+    "border",  "text"};
+const int kNumWords = sizeof(kWords) / sizeof(kWords[0]);
+
+// Classes elements are given, and rules select.
+const int kNumClasses = 64;
+// Every kIdInterval-th element has an id.
+const int kIdInterval = 8;
+
+// Only the raw output of the engine is used. The standard distributions are
+// implementation-defined, so pages would differ between standard libraries.
+class Random {
+  std::mt19937 engine_;
+
+ public:
+  explicit Random(uint32_t seed) : engine_(seed) {}
+  // Returns an integer in [0, n).
+  int below(int n) { return n <= 0 ? 0 : engine_() % n; }
+  bool chance(double p) { return engine_() < p * 4294967296.0; }
+};
+
+std::string randomWords(int count, Random* random) {
+  std::string words;
+  for (int w = 0; w < count; w++) {
+    words += kWords[random->below(kNumWords)];
+    words += " ";
+  }
+  return words;
+}
+
+// Whether to add a comment. Pages without comments draw no numbers for
+// them, so they stay the same as before comments could be generated.
+bool addComment(const PageSpec& spec, Random* random) {
+  return spec.comment_density > 0 && random->chance(spec.comment_density);
+}
+
+std::string randomColor(Random* random) {
+  return absl::StrFormat("#%02x%02x%02x", random->below(256),
+                         random->below(256), random->below(256));
+}
+
+std::string randomSelector(const PageSpec& spec, Random* random) {
+  int total = spec.tag_selectors + spec.class_selectors + spec.id_selectors +
+              spec.compound_selectors;
+  int pick = random->below(total);
+  std::string tag = kTags[random->below(kNumTags)];
+  std::string cls = absl::StrFormat(".c%d", random->below(kNumClasses));
+  if ((pick -= spec.tag_selectors) < 0) {
+    return tag;
+  } else if ((pick -= spec.class_selectors) < 0) {
+    return cls;
+  } else if ((pick -= spec.id_selectors) < 0) {
+    int ids = (spec.elements + kIdInterval - 1) / kIdInterval;
+    return absl::StrFormat("#e%d", random->below(ids) * kIdInterval);
+  }
+  return tag + cls;
+}
+
+std::string randomDeclarations(Random* random) {
+  std::string declarations;
+  switch (random->below(4)) {
+    case 0:
+      declarations += "color: " + randomColor(random) + "; ";
+      break;
+    case 1:
+      declarations += "background-color: " + randomColor(random) + "; ";
+      break;
+    case 2:
+      declarations += absl::StrFormat("font-size: %dpx; ",
+                                      12 + random->below(4) * 2);
+      break;
+    case 3:
+      declarations += absl::StrFormat("border-width: 1px; border-color: %s; ",
+                                      randomColor(random));
+      break;
+  }
+  declarations += absl::StrFormat("padding: %dpx; margin: %dpx;",
+                                  random->below(8), random->below(4));
+  return declarations;
+}
+
+}  // namespace
+
+Page generatePage(const PageSpec& spec) {
+  Random random(spec.seed);
+  Page page;
+  page.html = "<html>\n<body>\n";
+  // Tags of the elements that are open, outermost first.
+  std::vector<const char*> open;
+  for (int i = 0; i < spec.elements; i++) {
+    // Close the innermost elements at the depth limit, and sometimes sooner
+    // so that the tree is wide as well as deep.
+    while (!open.empty() &&
+           (open.size() >= static_cast<std::size_t>(spec.depth) ||
+            random.below(3) == 0)) {
+      page.html += absl::StrFormat("</%s>\n", open.back());
+      open.pop_back();
+    }
+    const char* tag = kTags[random.below(kNumTags)];
+    page.html += absl::StrFormat("<%s class=\"c%d\"", tag,
+                                 random.below(kNumClasses));
+    if (i % kIdInterval == 0) {
+      page.html += absl::StrFormat(" id=\"e%d\"", i);
+    }
+    page.html += ">";
+    page.elements++;
+    if (random.chance(spec.text_density)) {
+      page.html += randomWords(spec.words_per_text, &random);
+      page.text_nodes++;
+    }
+    page.html += "\n";
+    if (addComment(spec, &random)) {
+      page.html +=
+          "<!-- " + randomWords(spec.words_per_comment, &random) + "-->\n";
+      page.comments++;
+    }
+    open.push_back(tag);
+  }
+  while (!open.empty()) {
+    page.html += absl::StrFormat("</%s>\n", open.back());
+    open.pop_back();
+  }
+  page.html += "</body>\n</html>\n";
+
+  page.css = "body { font-size: 16px; color: #253237; }\n";
+  for (int i = 0; i < spec.rules; i++) {
+    if (addComment(spec, &random)) {
+      page.css +=
+          "/* " + randomWords(spec.words_per_comment, &random) + "*/\n";
+      page.comments++;
+    }
+    page.css += randomSelector(spec, &random) + " { " +
+                randomDeclarations(&random) + " }\n";
+  }
+  return page;
+}
+
+}  // namespace bench
@@ -0,0 +1,50 @@
+// Generates synthetic pages for benchmarking the pipeline.
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+namespace bench {
+
+// The shape of a synthetic page.
+struct PageSpec {
+  // Number of elements inside <body>, not counting text.
+  int elements = 2000;
+  // Deepest nesting of elements inside <body>.
+  int depth = 8;
+  // Fraction of elements with a run of text directly inside them.
+  double text_density = 0.5;
+  // Words in each run of text.
+  int words_per_text = 8;
+  // Fraction of elements followed by a comment, and of rules preceded by
+  // one, and the words in each comment.
+  double comment_density = 0;
+  int words_per_comment = 32;
+  // Number of author rules in the stylesheet.
+  int rules = 200;
+  // How often each kind of selector is used, relative to the others: a tag
+  // name, a class, an id, or a tag name with a class.
+  int tag_selectors = 1;
+  int class_selectors = 2;
+  int id_selectors = 1;
+  int compound_selectors = 1;
+  uint32_t seed = 1;
+};
+
+struct Page {
+  std::string html;
+  std::string css;
+  int elements = 0;
+  int text_nodes = 0;
+  int comments = 0;
+};
+
+// Generates a page with the given shape. A spec always produces the same
+// page, on any platform.
+Page generatePage(const PageSpec& spec);
+
+}  // namespace bench
+
+#endif
@@ -0,0 +1,271 @@
+// Benchmarks each phase of the pipeline on a synthetic page, without a
+// window, and reports the results as JSON.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <gflags/gflags.h>
+
+#include "absl/strings/str_format.h"
+
+#include "../dom.h"
+#include "../layout.h"
+#include "../parse/css.h"
+#include "../parse/html.h"
+#include "../parse/scan.h"
+#include "../render/glyph_atlas.h"
+#include "../render/paint.h"
+#include "../render/raster.h"
+#include "../render/text.h"
+#include "../style.h"
+#include "../trace.h"
+#include "../util.h"
+#include "generator.h"
+
+DEFINE_int32(elements, 2000, "elements in the generated page");
+DEFINE_int32(depth, 8, "deepest nesting of elements in the generated page");
+DEFINE_double(text_density, 0.5,
+              "fraction of elements with text directly inside them");
+DEFINE_int32(words_per_text, 8, "words in each run of text");
+DEFINE_double(comment_density, 0,
+              "fraction of elements followed by a comment, and of rules "
+              "preceded by one");
+DEFINE_int32(words_per_comment, 32, "words in each comment");
+DEFINE_int32(rules, 200, "author rules in the generated stylesheet");
+DEFINE_int32(tag_selectors, 1, "relative frequency of tag selectors");
+DEFINE_int32(class_selectors, 2, "relative frequency of class selectors");
+DEFINE_int32(id_selectors, 1, "relative frequency of id selectors");
+DEFINE_int32(compound_selectors, 1,
+             "relative frequency of tag.class selectors");
+DEFINE_int32(seed, 1, "seed for the page generator");
+DEFINE_int32(iterations, 10, "times to run the pipeline");
+DEFINE_string(scan_implementation, "",
+              "scanning implementation the parsers use: scalar, sse2 or avx2, "
+              "or empty for the one picked for this CPU");
+DEFINE_int32(viewport_width, 1000, "width to lay the page out at");
+DEFINE_int32(viewport_height, 800, "height of the area rasterized");
+DEFINE_string(json_file, "",
+              "file to write results to as JSON, or empty for stdout");
+DEFINE_string(trace_file, "",
+              "if set, write a Chrome trace of every iteration to this file");
+// Logs go to stdout, so by default only problems are logged, leaving the
+// JSON on its own.
+DEFINE_string(log_level, "warn",
+              "least severe messages to log: debug, info, warn or error");
+
+namespace {
+
+// The time each iteration spent in one phase.
+struct Phase {
+  std::string name;
+  // Bytes of input the phase consumes, for phases that read source.
+  std::size_t bytes = 0;
+  std::vector<double> ns;
+  double median() const {
+    std::vector<double> sorted = ns;
+    std::sort(sorted.begin(), sorted.end());
+    return sorted.empty() ? 0 : sorted[sorted.size() / 2];
+  }
+};
+
+class Timer {
+  std::chrono::steady_clock::time_point start_ =
+      std::chrono::steady_clock::now();
+
+ public:
+  // Adds the time since the timer started or was last stopped to `phase`.
+  void stop(Phase* phase) {
+    auto now = std::chrono::steady_clock::now();
+    phase->ns.push_back(
+        std::chrono::duration<double, std::nano>(now - start_).count());
+    start_ = now;
+  }
+};
+
+// Writes `contents` to a new temporary file and returns its path, since the
+// HTML parser maps its input from a file.
+std::string writeTempFile(const std::string& contents) {
+  char path[] = "/tmp/toy_browser_benchXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    logger::error("Unable to create a temporary file");
+    return "";
+  }
+  std::size_t written = 0;
+  while (written < contents.size()) {
+    ssize_t n =
+        write(fd, contents.data() + written, contents.size() - written);
+    if (n <= 0) {
+      logger::error(absl::StrFormat("Unable to write %s", path));
+      break;
+    }
+    written += n;
+  }
+  close(fd);
+  return path;
+}
+
+// `bazel run` starts the benchmark in its runfiles, where the fonts are, so
+// relative output paths are taken from the directory it was run from.
+std::string outputPath(const std::string& path) {
+  const char* directory = getenv("BUILD_WORKING_DIRECTORY");
+  if (directory == nullptr || path.empty() || path[0] == '/') {
+    return path;
+  }
+  return std::string(directory) + "/" + path;
+}
+
+std::string toJson(const bench::PageSpec& spec, const bench::Page& page,
+                   const std::vector<Phase>& phases) {
+  int nodes = page.elements + page.text_nodes;
+  std::string json = absl::StrFormat(
+      "{\n  \"page\": {\"elements\": %d, \"text_nodes\": %d, "
+      "\"comments\": %d, \"depth\": %d, \"rules\": %d, \"html_bytes\": %d, "
+      "\"css_bytes\": %d, \"seed\": %d},\n"
+      "  \"scan\": \"%s\",\n  \"iterations\": %d,\n  \"phases\": [\n",
+      page.elements, page.text_nodes, page.comments, spec.depth, spec.rules,
+      page.html.size(), page.css.size(), spec.seed,
+      scan::getImplementationName(), FLAGS_iterations);
+  for (std::size_t i = 0; i < phases.size(); i++) {
+    const Phase& phase = phases[i];
+    double median = phase.median();
+    json += absl::StrFormat(
+        "    {\"name\": \"%s\", \"median_ns\": %.0f, \"ns_per_node\": %.1f",
+        phase.name, median, median / std::max(nodes, 1));
+    if (phase.bytes > 0) {
+      json += absl::StrFormat(", \"mb_per_s\": %.1f",
+                              phase.bytes / (median / 1e9) / 1e6);
+    }
+    json += i + 1 < phases.size() ? "},\n" : "}\n";
+  }
+  json += "  ]\n}\n";
+  return json;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  logger::Level log_level;
+  if (!logger::parseLevel(FLAGS_log_level, &log_level)) {
+    logger::error("Unknown --log_level: " + FLAGS_log_level);
+    return 1;
+  }
+  logger::setLevel(log_level);
+  if (!FLAGS_scan_implementation.empty() &&
+      !scan::setImplementation(FLAGS_scan_implementation)) {
+    logger::error("Unsupported --scan_implementation: " +
+                  FLAGS_scan_implementation);
+    return 1;
+  }
+  if (!FLAGS_trace_file.empty()) {
+    trace::enable();
+    trace::setThreadName("main");
+  }
+  bench::PageSpec spec;
+  spec.elements = FLAGS_elements;
+  spec.depth = FLAGS_depth;
+  spec.text_density = FLAGS_text_density;
+  spec.words_per_text = FLAGS_words_per_text;
+  spec.comment_density = FLAGS_comment_density;
+  spec.words_per_comment = FLAGS_words_per_comment;
+  spec.rules = FLAGS_rules;
+  spec.tag_selectors = FLAGS_tag_selectors;
+  spec.class_selectors = FLAGS_class_selectors;
+  spec.id_selectors = FLAGS_id_selectors;
+  spec.compound_selectors = FLAGS_compound_selectors;
+  spec.seed = FLAGS_seed;
+  text_render::FontRegistry::getInstance()->preload();
+  const bench::Page page = bench::generatePage(spec);
+  const std::string html_path = writeTempFile(page.html);
+  if (html_path.empty()) {
+    return 1;
+  }
+
+  std::vector<Phase> phases(6);
+  Phase& parse_html = phases[0];
+  Phase& parse_css = phases[1];
+  Phase& style = phases[2];
+  Phase& layout = phases[3];
+  Phase& record = phases[4];
+  Phase& raster = phases[5];
+  parse_html.name = "parse_html";
+  parse_html.bytes = page.html.size();
+  parse_css.name = "parse_css";
+  parse_css.bytes = page.css.size();
+  style.name = "style";
+  layout.name = "layout";
+  record.name = "record";
+  raster.name = "raster";
+
+  layout::Dimensions viewport;
+  viewport.content.width = FLAGS_viewport_width;
+  viewport.content.height = FLAGS_viewport_height;
+  layout::Rect area;
+  area.width = FLAGS_viewport_width;
+  area.height = FLAGS_viewport_height;
+  // Rasterize in software, so no display or GL context is needed.
+  raster::Framebuffer framebuffer;
+  framebuffer.create(area.width, area.height);
+  for (int i = 0; i < FLAGS_iterations; i++) {
+    std::unique_ptr<io::MappedFile> source(new io::MappedFile(html_path));
+    Timer timer;
+    std::unique_ptr<dom::Document> document =
+        html_parser::parseHtml(std::move(source));
+    timer.stop(&parse_html);
+    const std::unique_ptr<css::StyleSheet const> stylesheet =
+        css::parseCss(page.css);
+    timer.stop(&parse_css);
+    style::StyleSharingCache style_cache;
+    style::StyledNode* styled_node =
+        style::styleTree(document->get_root(), stylesheet,
+                         style::PropertyMap(), document->get_arena(),
+                         &style_cache);
+    timer.stop(&style);
+    layout::LayoutElement* layout_root = layout::layout_tree(
+        *styled_node, viewport, document->get_layout_arena());
+    timer.stop(&layout);
+    DisplayList display_list;
+    buildDisplayList(*layout_root, &display_list);
+    timer.stop(&record);
+    framebuffer.clear(sf::Color::Black);
+    display_list.replay(&framebuffer, area);
+    timer.stop(&raster);
+  }
+  unlink(html_path.c_str());
+
+  // A summary for people, on stderr so that stdout stays JSON.
+  int nodes = page.elements + page.text_nodes;
+  for (const Phase& phase : phases) {
+    std::cerr << absl::StrFormat("%-10s %10.3fms %8.1fns/node\n", phase.name,
+                                 phase.median() / 1e6,
+                                 phase.median() / std::max(nodes, 1));
+  }
+  std::string json = toJson(spec, page, phases);
+  if (FLAGS_json_file.empty()) {
+    std::cout << json;
+  } else {
+    std::string json_path = outputPath(FLAGS_json_file);
+    std::ofstream out(json_path);
+    out << json;
+    if (!out) {
+      logger::error("Unable to write " + json_path);
+      return 1;
+    }
+  }
+  text_render::FontRegistry::getInstance()->clear();
+  raster::GlyphAtlas::getInstance()->clear();
+  if (!FLAGS_trace_file.empty() &&
+      !trace::write(outputPath(FLAGS_trace_file))) {
+    return 1;
+  }
+  return 0;
+}
@@ -90,31 +90,21 @@ sf::Color parseColor(std::string colorStr) {
     colorStr.insert(5, colorStr.substr(5, 1));
   }
 
-  char r_pair[2];
+  char r_pair[3];
   strcpy(r_pair, colorStr.substr(1, 2).c_str());
   rgb.r = hexadecimalToDecimal(r_pair);
 
-  char g_pair[2];
+  char g_pair[3];
   strcpy(g_pair, colorStr.substr(3, 2).c_str());
   rgb.g = hexadecimalToDecimal(g_pair);
 
-  char b_pair[2];
+  char b_pair[3];
   strcpy(b_pair, colorStr.substr(5, 2).c_str());
   rgb.b = hexadecimalToDecimal(b_pair);
 
-  char a_pair[2];
+  char a_pair[3];
   strcpy(a_pair, "FF");
   rgb.a = hexadecimalToDecimal(a_pair);
   return rgb;
 }
-// Extract the specified color value for the element
-sf::Color getColor(const layout::LayoutElement& box,
-                   const std::string& colorType) {
-  std::string c = box.getStyleValue(colorType, constants::DEFAULT);
-  if (c == constants::DEFAULT) {
-    return sf::Color::White;
-  }
-  sf::Color color = parseColor(c);
-  return color;
-}
 }  // namespace color
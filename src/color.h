@@ -1,17 +1,22 @@
 #ifndef COLOR_H
 #define COLOR_H
 
+#include <cstdint>
 #include <string>
 #include "SFML/Graphics.hpp"
 
-#include "layout.h"
-
 namespace color {
 
 sf::Color parseColor(std::string rawColor);
 
-sf::Color getColor(const layout::LayoutElement& box,
-                   const std::string& colorType);
+// Packs a color as 0xRRGGBBAA. Parsed colors are always opaque, so a packed
+// value of 0 is free to mean "unspecified".
+inline uint32_t pack(sf::Color color) { return color.toInteger(); }
+
+// Unpacks a color, substituting `fallback` if it was unspecified.
+inline sf::Color unpack(uint32_t packed, sf::Color fallback) {
+  return packed == 0 ? fallback : sf::Color(packed);
+}
 
 inline std::string toLogStr(sf::Color color) {
   return "RGB=" + std::to_string(unsigned(color.r)) + "," +
@@ -7,6 +7,7 @@
 #include <regex>
 #include <vector>
 
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_split.h"
 
@@ -19,23 +20,26 @@ const std::vector<std::string> METATAGS = {
 
 namespace dom {
 
-std::string TextNode::toLogStr() const { return "text = '" + text_ + "'"; }
+std::string TextNode::toLogStr() const {
+  return absl::StrCat("text = '", text_, "'");
+}
 
 std::string ElementNode::toLogStr() const {
   return absl::StrFormat("\n\ttag: %s\n\tid: %s\n\tclasses: %s", get_tag(),
                          get_id(), getAttr(constants::html_attributes::CLASS));
 }
 
-std::vector<std::string> ElementNode::get_classes() const {
-  return absl::StrSplit(getAttr(constants::html_attributes::CLASS), ' ');
+std::vector<absl::string_view> ElementNode::get_classes() const {
+  return absl::StrSplit(getAttr(constants::html_attributes::CLASS),
+                        absl::ByAnyChar(" \t\n"), absl::SkipEmpty());
 }
 
-std::string ElementNode::get_id() const {
+absl::string_view ElementNode::get_id() const {
   return getAttr(constants::html_attributes::ID);
 }
 
-std::string ElementNode::getAttr(const std::string &attribute,
-                                 const std::string &default_value) const {
+absl::string_view ElementNode::getAttr(absl::string_view attribute,
+                                       absl::string_view default_value) const {
   auto it = attrs_.find(attribute);
   if (it == attrs_.end()) {
     return default_value;
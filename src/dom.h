@@ -3,89 +3,114 @@
 #ifndef DOM_H
 #define DOM_H
 
+#include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <vector>
 
+#include "absl/strings/string_view.h"
+
+#include "arena.h"
 #include "constants.h"
+#include "tree.h"
+#include "util.h"
 
-typedef std::map<std::string, std::string> Attrs;
+// Attribute names and values are views into the document source.
+typedef std::map<absl::string_view, absl::string_view> Attrs;
 
 namespace dom {
 
 // Represents a node in the DOM tree. Can be either TextNode or ElementNode.
-class Node {
- private:
-  std::vector<std::unique_ptr<Node>> children_;
-
+// Nodes are allocated in their Document's arena.
+class Node : public tree::TreeNode<Node> {
  public:
   Node(){};
-  Node(std::vector<std::unique_ptr<Node>> children) {
-    children_ = std::move(children);
-  };
   virtual ~Node() {}
   // Delete copy constructor
   Node(const Node &node) = delete;
   Node &operator=(const Node &node) = delete;
 
-  std::vector<std::reference_wrapper<Node>> get_children() const {
-    std::vector<std::reference_wrapper<Node>> children;
-    for (const auto &child : children_) {
-      children.push_back(*child);
-    }
-    return children;
-  };
-
   virtual std::string toLogStr() const = 0;
 };
 
-// Represents a raw text node.
+// Represents a run of text between two tags. The text is a view into the
+// document source, from the start of the first word to the end of the last,
+// with its whitespace as written. Words are located by their offsets in it.
 class TextNode : public Node {
-  const std::string text_;
+  const absl::string_view text_;
+  // Start and end offsets of each word in `text_`, in pairs.
+  const std::vector<uint32_t> word_breaks_;
 
  public:
   // Delete copy constructor
   TextNode(const TextNode &node) = delete;
-  TextNode(std::string text) : text_(std::move(text)) {}
-  TextNode(std::string text, std::vector<std::unique_ptr<Node>> children)
-      : Node(std::move(children)), text_(std::move(text)) {}
-  std::string get_text() const { return text_; }
+  TextNode(absl::string_view text, std::vector<uint32_t> word_breaks)
+      : text_(text), word_breaks_(std::move(word_breaks)) {}
+  absl::string_view get_text() const { return text_; }
+  int get_word_count() const { return word_breaks_.size() / 2; }
+  absl::string_view get_word(int i) const {
+    return text_.substr(word_breaks_[2 * i],
+                        word_breaks_[2 * i + 1] - word_breaks_[2 * i]);
+  }
 
   std::string toLogStr() const override;
 };
 
-// Represents any non-text node of the DOM.
+// Represents any non-text node of the DOM. The tag name and attributes are
+// views into the document source.
 class ElementNode : public Node {
  private:
-  const std::string tag_name_;
-  const std::map<std::string, std::string> attrs_;
+  const absl::string_view tag_name_;
+  const Attrs attrs_;
 
  public:
   ElementNode(const ElementNode &node) = delete;
 
-  ElementNode(std::string tag_name, Attrs attrs)
-      : tag_name_(std::move(tag_name)), attrs_(std::move(attrs)){};
-  ElementNode(std::string tag_name, Attrs attrs,
-              std::vector<std::unique_ptr<Node>> children)
-      : Node(std::move(children)),
-        tag_name_(std::move(tag_name)),
-        attrs_(std::move(attrs)){};
+  ElementNode(absl::string_view tag_name, Attrs attrs)
+      : tag_name_(tag_name), attrs_(std::move(attrs)){};
 
-  std::string get_id() const;
-  std::string get_tag() const { return tag_name_; };
-  std::vector<std::string> get_classes() const;
+  absl::string_view get_id() const;
+  absl::string_view get_tag() const { return tag_name_; };
+  std::vector<absl::string_view> get_classes() const;
 
   // Returns whether this node is one that is displayed to the screen,
   // or something like <head>, <meta> that are used for metadata only.
   bool isDisplayable() const;
   // Return the provided attribute. Returns the provided default_value
   // if the attribute is not present in attrs_.
-  std::string getAttr(
-      const std::string &property,
-      const std::string &default_value = constants::DEFAULT) const;
+  absl::string_view getAttr(
+      absl::string_view property,
+      absl::string_view default_value = constants::DEFAULT) const;
   std::string toLogStr() const override;
 };
 
+// Owns a parsed document. The DOM, styled and layout trees are all allocated
+// in the document's arenas, and are freed together with the document. The
+// source file stays mapped for as long as the DOM refers to it.
+class Document {
+  std::unique_ptr<io::MappedFile> source_;
+  arena::Arena arena_;
+  arena::Arena layout_arena_;
+  Node *root_ = nullptr;
+
+ public:
+  Document(std::unique_ptr<io::MappedFile> source)
+      : source_(std::move(source)){};
+  Document(const Document &document) = delete;
+  Document &operator=(const Document &document) = delete;
+
+  // Arena for the DOM and styled trees.
+  arena::Arena *get_arena() { return &arena_; }
+  // The layout tree is built once and laid out again in place when the
+  // viewport changes. It gets its own arena so it can be dropped and rebuilt
+  // without touching the DOM.
+  arena::Arena *get_layout_arena() { return &layout_arena_; }
+  absl::string_view get_source() const { return source_->get_contents(); }
+  Node &get_root() const { return *root_; }
+  void set_root(Node *root) { root_ = root; }
+};
+
 }  // namespace dom
 
 #endif
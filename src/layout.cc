@@ -3,10 +3,22 @@
 #include "absl/strings/ascii.h"
 #include "absl/strings/str_format.h"
 
+#include "parse/image_header.h"
+#include "render/image.h"
 #include "render/text.h"
+#include "trace.h"
 #include "util.h"
 
 namespace layout {
+
+namespace {
+LayoutStats layout_stats;
+}  // namespace
+
+const LayoutStats &getLayoutStats() { return layout_stats; }
+
+void resetLayoutStats() { layout_stats = LayoutStats(); }
+
 Rect expand(Rect rect, EdgeSizes edge) {
   Rect expanded;
   expanded.x = rect.x - edge.left;
@@ -23,48 +35,130 @@ Rect Dimensions::marginBox() const { return expand(borderBox(), margin); }
 void LayoutElement::setHeight() {
   // If the height is set to an explicit length, use that exact length.
   // Otherwise, we just keep the value set by `layoutChildren`.
-  if (get_display_type() == style::Text) {
-    dimensions.content.height = text_render::getTextHeight(this);
-  } else if (getStyleValue(constants::css_properties::HEIGHT, "-1") != "-1") {
-    int height = std::stoi(getStyleValue(constants::css_properties::HEIGHT));
-    dimensions.content.height = height;
+  if (style_.height.resolve(-1) != -1) {
+    dimensions.content.height = style_.height.px;
+  } else if (box_type_ == Img && intrinsic_width_ > 0) {
+    // Keep the image's aspect ratio.
+    dimensions.content.height =
+        dimensions.content.width * intrinsic_height_ / intrinsic_width_;
   }
 }
 
-LayoutElement::LayoutElement(dom::Node &node, style::PropertyMap style_values,
-                             style::DisplayType display_type,
-                             BoxType box_type) {
-  display_type_ = display_type;
+LayoutElement::LayoutElement(dom::Node &node,
+                             const style::ComputedStyle &style,
+                             BoxType box_type)
+    : style_(style) {
+  display_type_ = style.display;
   box_type_ = box_type;
-  style_values_ = style_values;
 
-  if (display_type == style::Text) {
+  if (display_type_ == style::Text) {
     dom::TextNode &castToText = dynamic_cast<dom::TextNode &>(node);
     if (&castToText != &node) {
       logger::error("The provided node is not a text node");
     }
-    raw_data_ = castToText.get_text();
-    text_node_ = text_render::constructText(this, castToText.get_text());
+    raw_data_ = std::string(castToText.get_text());
+    // Measure each word once; line breaking only needs the widths.
+    text_run_ = &castToText;
+    text_render::TextMeasurer measurer(this);
+    space_width_ = measurer.getWidth(" ");
+    word_widths_.reserve(text_run_->get_word_count());
+    for (int i = 0; i < text_run_->get_word_count(); i++) {
+      word_widths_.push_back(measurer.getWidth(text_run_->get_word(i)));
+    }
   }
   if (box_type == Img) {
     dom::ElementNode &castToElement = dynamic_cast<dom::ElementNode &>(node);
-    raw_data_ = castToElement.getAttr(constants::html_attributes::SRC, "/");
+    raw_data_ = std::string(
+        castToElement.getAttr(constants::html_attributes::SRC, "/"));
+    // Size the box from the image's header, so layout doesn't have to wait
+    // for the image to be decoded. Other formats are sized once decoded, by
+    // sizeDecodedImages(). Until then the box has no height, so painting
+    // wouldn't reach it to start the decode.
+    const std::string path = image_render::resolvePath(raw_data_);
+    image_header::ImageSize size;
+    if (image_header::readImageSize(path, &size) && size.width > 0 &&
+        size.height > 0) {
+      intrinsic_width_ = size.width;
+      intrinsic_height_ = size.height;
+    } else {
+      image_render::ImageCache *image_cache =
+          image_render::ImageCache::getInstance();
+      image_cache->load(path);
+      image_cache->getSize(path, &intrinsic_width_, &intrinsic_height_);
+    }
   }
 }
 
+bool LayoutElement::sizeDecodedImages() {
+  bool sized = false;
+  if (box_type_ == Img && intrinsic_width_ == 0) {
+    sized = image_render::ImageCache::getInstance()->getSize(
+        image_render::resolvePath(raw_data_), &intrinsic_width_,
+        &intrinsic_height_);
+  }
+  for (LayoutElement &child : get_children()) {
+    sized = child.sizeDecodedImages() || sized;
+  }
+  // The previous layout of a box containing a resized image can't be reused.
+  if (sized) {
+    laid_out_ = false;
+  }
+  return sized;
+}
+
 void LayoutElement::applyLayout(Dimensions container, int xCursor, int yCursor,
                                 bool shouldRenderBelow) {
+  TRACE_SPAN("applyLayout");
+  Rect previous = dimensions.content;
   // Child width can depend on parent width, so we need to calculate this box's
   // width before laying out its children.
   calculateWidth(container);
   // Determine where the box is located within its container.
   calculatePosition(container, xCursor, yCursor, shouldRenderBelow);
-  // Recursively lay out the children of this box.
+  // If the box's contents can't have changed since the last layout, keep
+  // them and just move them along with the box.
+  if (laid_out_ && hasFixedWidth()) {
+    dimensions.content.height = previous.height;
+    for (LayoutElement &child : get_children()) {
+      child.translate(dimensions.content.x - previous.x,
+                      dimensions.content.y - previous.y);
+    }
+    layout_stats.subtrees_reused++;
+    return;
+  }
+  layout_stats.boxes_laid_out++;
+  // Recursively lay out the children of this box. The height is accumulated
+  // from the children, so start from zero.
+  dimensions.content.height = 0;
   layoutChildren(container.content.width - container.padding.left -
                  container.padding.right);
   // If an explicit height is available, overwrite the height set by the
   // children
   setHeight();
+  laid_out_ = true;
+}
+
+bool LayoutElement::hasFixedWidth() const {
+  // Inline-like boxes lay their children out against their container's width,
+  // so only block-like boxes with an explicit width qualify.
+  return (get_display_type() == style::Block ||
+          get_display_type() == style::Flex) &&
+         style_.width.resolve(-1) != -1;
+}
+
+void LayoutElement::translate(int dx, int dy) {
+  if (dx == 0 && dy == 0) {
+    return;
+  }
+  dimensions.content.x += dx;
+  dimensions.content.y += dy;
+  for (TextLine &line : text_lines_) {
+    line.rect.x += dx;
+    line.rect.y += dy;
+  }
+  for (LayoutElement &child : get_children()) {
+    child.translate(dx, dy);
+  }
 }
 
 bool isBlockLike(style::DisplayType display_type) {
@@ -76,23 +170,20 @@ bool isInlineLike(style::DisplayType display_type) {
 }
 
 void LayoutElement::calculateWidth(Dimensions container) {
-  int paddingLeft =
-      std::stoi(getStyleValue(constants::css_properties::PADDING_LEFT, "0"));
-  int paddingRight =
-      std::stoi(getStyleValue(constants::css_properties::PADDING_RIGHT, "0"));
-  int borderLeft = std::stoi(
-      getStyleValue(constants::css_properties::BORDER_LEFT_WIDTH, "0"));
-  int borderRight = std::stoi(
-      getStyleValue(constants::css_properties::BORDER_RIGHT_WIDTH, "0"));
-  int marginLeft =
-      std::stoi(getStyleValue(constants::css_properties::MARGIN_LEFT, "0"));
-  int marginRight =
-      std::stoi(getStyleValue(constants::css_properties::MARGIN_RIGHT, "0"));
-  int width;
-  if (get_display_type() == style::Text) {
-    width = text_render::getTextWidth(this);
-  } else {
-    width = std::stoi(getStyleValue(constants::css_properties::WIDTH, "-1"));
+  // Auto lengths are represented as -1 throughout the width calculation.
+  int paddingLeft = style_.padding.left.resolve(-1);
+  int paddingRight = style_.padding.right.resolve(-1);
+  int borderLeft = style_.border_width.left.resolve(-1);
+  int borderRight = style_.border_width.right.resolve(-1);
+  int marginLeft = style_.margin.left.resolve(-1);
+  int marginRight = style_.margin.right.resolve(-1);
+  int width = style_.width.resolve(-1);
+  if (width == -1 && box_type_ == Img && intrinsic_width_ > 0) {
+    // An image without a width is as wide as the image, scaled to its height
+    // if that is given.
+    int height = style_.height.resolve(-1);
+    width = height == -1 ? intrinsic_width_
+                         : height * intrinsic_width_ / intrinsic_height_;
   }
 
   int total = paddingLeft + paddingRight + std::max(marginLeft, 0) +
@@ -115,8 +206,7 @@ void LayoutElement::calculateWidth(Dimensions container) {
   // container.padding.right - total;
 
   style::DisplayType dt = get_display_type();
-  if (dt == style::Text || dt == style::Inline ||
-      (dt == style::FlexChild && width == -1)) {
+  if (dt == style::Inline || (dt == style::FlexChild && width == -1)) {
     width = total;
   }
   if (width == -1) {
@@ -158,18 +248,12 @@ void LayoutElement::calculateWidth(Dimensions container) {
 }
 void LayoutElement::calculatePosition(Dimensions container, int xCursor,
                                       int yCursor, bool shouldRenderBelow) {
-  int paddingTop =
-      std::stoi(getStyleValue(constants::css_properties::PADDING_TOP, "0"));
-  int paddingBottom =
-      std::stoi(getStyleValue(constants::css_properties::PADDING_BOTTOM, "0"));
-  int borderTop = std::stoi(
-      getStyleValue(constants::css_properties::BORDER_TOP_WIDTH, "0"));
-  int borderBottom = std::stoi(
-      getStyleValue(constants::css_properties::BORDER_BOTTOM_WIDTH, "0"));
-  int marginTop =
-      std::stoi(getStyleValue(constants::css_properties::MARGIN_TOP, "0"));
-  int marginBottom =
-      std::stoi(getStyleValue(constants::css_properties::MARGIN_BOTTOM, "0"));
+  int paddingTop = style_.padding.top.resolve(-1);
+  int paddingBottom = style_.padding.bottom.resolve(-1);
+  int borderTop = style_.border_width.top.resolve(-1);
+  int borderBottom = style_.border_width.bottom.resolve(-1);
+  int marginTop = style_.margin.top.resolve(-1);
+  int marginBottom = style_.margin.bottom.resolve(-1);
 
   dimensions.padding.top = paddingTop;
   dimensions.padding.bottom = paddingBottom;
@@ -188,14 +272,101 @@ void LayoutElement::calculatePosition(Dimensions container, int xCursor,
   dimensions.content.y = y;
 }
 
+int LayoutElement::getTokenWidth(int token) const {
+  return token % 2 == 0 ? word_widths_[token / 2] : space_width_;
+}
+
+sf::Text &LayoutElement::getLineTextNode(int i) {
+  const TextLine &line = text_lines_[i];
+  if (line_texts_.size() <= static_cast<std::size_t>(i)) {
+    line_texts_.resize(i + 1);
+  }
+  LineText &line_text = line_texts_[i];
+  if (line_text.text == nullptr) {
+    line_text.text = text_render::constructText(this, getLineText(line));
+  } else if (line_text.first_token != line.first_token ||
+             line_text.end_token != line.end_token) {
+    line_text.text->setString(getLineText(line));
+  }
+  line_text.first_token = line.first_token;
+  line_text.end_token = line.end_token;
+  return *line_text.text;
+}
+
+std::string LayoutElement::getLineText(const TextLine &line) const {
+  std::string text;
+  for (int token = line.first_token; token < line.end_token; token++) {
+    if (token % 2 == 0) {
+      absl::string_view word = text_run_->get_word(token / 2);
+      text.append(word.data(), word.size());
+    } else {
+      text.push_back(' ');
+    }
+  }
+  return text;
+}
+
+void LayoutElement::layoutTextRun(LayoutElement &text, int availableWidth,
+                                  FlowCursor *cursor) {
+  // Each token is placed exactly as a separate inline box of its width would
+  // be, and consecutive tokens on the same row are gathered into one line.
+  int height = text_render::getTextHeight(&text);
+  text.text_lines_.clear();
+  for (int token = 0; token < 2 * text.text_run_->get_word_count(); token++) {
+    int width = text.getTokenWidth(token);
+    bool shouldRenderBelow =
+        cursor->prev_is_block || cursor->x + width > availableWidth;
+    if (shouldRenderBelow) {
+      cursor->y += cursor->prev_height;
+      cursor->x = 0;
+    }
+    if (shouldRenderBelow || text.text_lines_.empty()) {
+      TextLine line;
+      line.rect.x = dimensions.content.x + cursor->x;
+      line.rect.y = dimensions.content.y + cursor->y;
+      line.rect.height = height;
+      line.first_token = token;
+      text.text_lines_.push_back(line);
+    }
+    TextLine &line = text.text_lines_.back();
+    line.rect.width += width;
+    line.end_token = token + 1;
+
+    cursor->x += width;
+    if (get_display_type() == style::Inline ||
+        (get_display_type() == style::FlexChild &&
+         style_.width.resolve(-1) == -1)) {
+      dimensions.content.width += width;
+    }
+    if (shouldRenderBelow) {
+      dimensions.content.height += height;
+    }
+    dimensions.content.height = std::max(dimensions.content.height, height);
+    cursor->prev_height = height;
+    cursor->prev_is_block = false;
+  }
+
+  // The run's own box is the bounding box of its lines.
+  Rect bounds;
+  if (!text.text_lines_.empty()) {
+    bounds = text.text_lines_.front().rect;
+    for (const TextLine &line : text.text_lines_) {
+      int right =
+          std::max(bounds.x + bounds.width, line.rect.x + line.rect.width);
+      bounds.x = std::min(bounds.x, line.rect.x);
+      bounds.width = right - bounds.x;
+      bounds.height = line.rect.y + line.rect.height - bounds.y;
+    }
+  }
+  text.dimensions = Dimensions();
+  text.dimensions.content = bounds;
+}
+
 void LayoutElement::layoutChildren(int parentWidth) {
   // Cursor to keep track of where a each child element should render
   // relative to its siblings.
-  int xCursor = 0;
-  int yCursor = 0;
+  FlowCursor cursor;
   int i = 0;
-  bool prevElementIsBlock = false;
-  int prevElementHeight = 0;
   int availableChildWidth;
   if (isInlineLike(get_display_type())) {
     availableChildWidth = parentWidth;
@@ -203,35 +374,40 @@ void LayoutElement::layoutChildren(int parentWidth) {
     availableChildWidth = dimensions.content.width;
   }
   for (LayoutElement &child : get_children()) {
-    logger::debug(absl::StrFormat("Laying out %d child #%d of %d",
-                                  child.get_display_type(), i,
-                                  get_display_type()));
+    LOG_DEBUG(absl::StrFormat("Laying out %d child #%d of %d",
+                              child.get_display_type(), i,
+                              get_display_type()));
+    i++;
+    if (child.get_display_type() == style::Text) {
+      // Text runs break across rows word by word.
+      layoutTextRun(child, availableChildWidth, &cursor);
+      continue;
+    }
     bool currElementIsBlock = isBlockLike(child.get_display_type());
     child.calculateWidth(dimensions);
     // Would adding this child element to the current row put us over the
     // maximum width of the container?
     bool overflow =
-        xCursor + child.dimensions.content.width > availableChildWidth;
+        cursor.x + child.dimensions.content.width > availableChildWidth;
     // Block elements, or elements following block elements, will render
     // below the previous element.
     bool shouldRenderBelow =
-        prevElementIsBlock || currElementIsBlock || overflow;
+        cursor.prev_is_block || currElementIsBlock || overflow;
 
     // If we are rendering below the previous element, we reset the xCursor
     // and increment the yCursor.
     if (shouldRenderBelow) {
-      yCursor += prevElementHeight;
-      xCursor = 0;
+      cursor.y += cursor.prev_height;
+      cursor.x = 0;
     }
-    i++;
-    child.applyLayout(dimensions, xCursor, yCursor, shouldRenderBelow);
+    child.applyLayout(dimensions, cursor.x, cursor.y, shouldRenderBelow);
     if (!isBlockLike(child.get_display_type())) {
       // Elements can render next to rather than below an inline element so
       // we increment the xCursor
-      xCursor += child.dimensions.borderBox().width;
+      cursor.x += child.dimensions.borderBox().width;
       if (get_display_type() == style::Inline ||
           (get_display_type() == style::FlexChild &&
-           getStyleValue(constants::css_properties::WIDTH, "-1") == "-1")) {
+           style_.width.resolve(-1) == -1)) {
         dimensions.content.width += child.dimensions.content.width;
       }
     }
@@ -246,8 +422,8 @@ void LayoutElement::layoutChildren(int parentWidth) {
       dimensions.content.height = child.dimensions.marginBox().height;
     }
 
-    prevElementHeight = child.dimensions.marginBox().height;
-    prevElementIsBlock = currElementIsBlock;
+    cursor.prev_height = child.dimensions.marginBox().height;
+    cursor.prev_is_block = currElementIsBlock;
   }
 }
 
@@ -263,27 +439,31 @@ BoxType parseBoxType(const std::string &tag) {
   }
 }
 
-std::unique_ptr<LayoutElement> build_layout_tree(
-    const style::StyledNode &styleTree) {
-  std::unique_ptr<LayoutElement> layoutTree(new LayoutElement(
-      styleTree.get_node(), styleTree.get_style_values(),
-      styleTree.get_display_type(), parseBoxType(styleTree.get_tag())));
-  for (auto c : styleTree.get_children()) {
-    std::unique_ptr<LayoutElement> childTree = build_layout_tree(c);
-    layoutTree->addChild(std::move(childTree));
+LayoutElement *build_layout_tree(const style::StyledNode &styleTree,
+                                 arena::Arena *arena) {
+  TRACE_SPAN("build_layout_tree");
+  LayoutElement *layoutTree = arena->make<LayoutElement>(
+      styleTree.get_node(), styleTree.get_style(),
+      parseBoxType(styleTree.get_tag()));
+  for (const style::StyledNode &c : styleTree.get_children()) {
+    layoutTree->appendChild(build_layout_tree(c, arena));
   }
   return layoutTree;
 }
 
-std::unique_ptr<LayoutElement> layout_tree(const style::StyledNode &styleTree,
-                                           Dimensions container) {
-  logger::info("****** Building layout ******");
+void relayout(LayoutElement *root, Dimensions container) {
   // The layout algorithm expects the container height to start at 0.
   // TODO: Save the initial containing block height, for calculating percent
   // heights.
   container.content.height = 0.0;
-  std::unique_ptr<LayoutElement> root = build_layout_tree(styleTree);
   root->applyLayout(container);
+}
+
+LayoutElement *layout_tree(const style::StyledNode &styleTree,
+                           Dimensions container, arena::Arena *arena) {
+  logger::info("****** Building layout ******");
+  LayoutElement *root = build_layout_tree(styleTree, arena);
+  relayout(root, container);
   return root;
 }
 }  // namespace layout
@@ -7,8 +7,10 @@
 
 #include "SFML/Graphics.hpp"
 
+#include "arena.h"
 #include "constants.h"
 #include "style.h"
+#include "tree.h"
 
 namespace layout {
 
@@ -43,52 +45,112 @@ struct Dimensions {
 
 enum BoxType { Img, Text, Bullet, Shape };
 
-class LayoutElement {
-  std::vector<std::unique_ptr<LayoutElement>> children_;
+// One line of a text run. A run is laid out as a sequence of tokens that
+// alternate between a word and the space after it, so token 2i is word i and
+// token 2i + 1 is the space that follows it.
+struct TextLine {
+  Rect rect;
+  int first_token = 0;
+  int end_token = 0;
+};
+
+// Tracks where the next child goes while laying out a box's children.
+struct FlowCursor {
+  int x = 0;
+  int y = 0;
+  bool prev_is_block = false;
+  int prev_height = 0;
+};
+
+// Counters describing how much work the last layout pass did.
+struct LayoutStats {
+  long boxes_laid_out = 0;
+  // Fixed-width subtrees whose previous layout was reused.
+  long subtrees_reused = 0;
+};
+
+const LayoutStats &getLayoutStats();
+void resetLayoutStats();
+
+// A box in the layout tree. LayoutElements are allocated in an arena. The
+// tree is built once per styled tree and laid out again in place whenever the
+// viewport changes.
+class LayoutElement : public tree::TreeNode<LayoutElement> {
   std::string raw_data_;
-  std::unique_ptr<sf::Text> text_node_;
-  style::PropertyMap style_values_;
+  const style::ComputedStyle &style_;
   BoxType box_type_;
   style::DisplayType display_type_;
+  // For text runs: the run, the measured width of each word and of a space,
+  // and the lines the run was broken into by the last layout.
+  const dom::TextNode *text_run_ = nullptr;
+  std::vector<int> word_widths_;
+  int space_width_ = 0;
+  std::vector<TextLine> text_lines_;
+  // Text objects for drawing each line, kept across layouts. Each remembers
+  // the tokens it was last set to, so a line that didn't change isn't
+  // re-shaped.
+  struct LineText {
+    std::unique_ptr<sf::Text> text;
+    int first_token = -1;
+    int end_token = -1;
+  };
+  std::vector<LineText> line_texts_;
+  // For images: the image's own size, read from its file header or from the
+  // decoded image. Zero until one of them is available.
+  int intrinsic_width_ = 0;
+  int intrinsic_height_ = 0;
+  // Whether this box has been laid out before, so its previous layout can be
+  // reused.
+  bool laid_out_ = false;
   void calculateWidth(Dimensions container);
   void calculatePosition(Dimensions container, int xCursor, int yCursor,
                          bool shouldRenderBelow);
   void setHeight();
   void layoutChildren(int parentWidth);
+  // Breaks the text run `text` into lines, continuing the flow of this box's
+  // children from `cursor`.
+  void layoutTextRun(LayoutElement &text, int availableWidth,
+                     FlowCursor *cursor);
+  // Returns true if nothing inside this box depends on its container's width,
+  // so only the box's own position needs to be recomputed.
+  bool hasFixedWidth() const;
+  // Moves this box and everything inside it.
+  void translate(int dx, int dy);
 
  public:
   Dimensions dimensions;
-  LayoutElement(dom::Node &node, style::PropertyMap style_values,
-                style::DisplayType display_type, BoxType box_type);
+  LayoutElement(dom::Node &node, const style::ComputedStyle &style,
+                BoxType box_type);
   std::string get_raw_data() const { return raw_data_; };
   BoxType get_box_type() const { return box_type_; };
   style::DisplayType get_display_type() const { return display_type_; };
-  std::unique_ptr<sf::Text> take_text_node() { return std::move(text_node_); };
-  const sf::Text &get_text_node() { return *text_node_; };
-  std::vector<std::reference_wrapper<LayoutElement>> get_children() const {
-    std::vector<std::reference_wrapper<LayoutElement>> children;
-    for (auto const &child : children_) {
-      children.push_back(*child);
-    }
-    return children;
-  };
-  void addChild(std::unique_ptr<LayoutElement> child) {
-    children_.push_back(std::move(child));
-  }
+  const std::vector<TextLine> &get_text_lines() const { return text_lines_; }
+  int getTokenWidth(int token) const;
+  // Returns the text of a line, with a single space after each word.
+  std::string getLineText(const TextLine &line) const;
+  // Returns a text object for drawing line `i`, reusing the one from the
+  // previous frame where possible.
+  sf::Text &getLineTextNode(int i);
   void applyLayout(Dimensions container, int xCursor = 0, int yCursor = 0,
                    bool shouldRenderBelow = true);
-  std::string getStyleValue(
-      const std::string &property,
-      const std::string &defaultValue = constants::DEFAULT) const {
-    return style::getValue(style_values_, property, defaultValue);
-  }
+  // Sizes the images in this subtree whose headers couldn't be read, from
+  // images that have since been decoded. Returns true if any were sized, in
+  // which case the tree must be laid out again.
+  bool sizeDecodedImages();
+  const style::ComputedStyle &get_style() const { return style_; }
 };
 
-std::unique_ptr<LayoutElement> build_layout_tree(
-    const style::StyledNode &styleTree);
+LayoutElement *build_layout_tree(const style::StyledNode &styleTree,
+                                 arena::Arena *arena);
+
+// Lays out an existing layout tree for `container`. Subtrees whose layout
+// can't have changed since the previous call are moved rather than laid out
+// again.
+void relayout(LayoutElement *root, Dimensions container);
 
-std::unique_ptr<LayoutElement> layout_tree(const style::StyledNode &styleTree,
-                                           Dimensions container);
+// Builds and lays out a layout tree, allocating it in `arena`.
+LayoutElement *layout_tree(const style::StyledNode &styleTree,
+                           Dimensions container, arena::Arena *arena);
 }  // namespace layout
 
 #endif
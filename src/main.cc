@@ -1,107 +1,723 @@
 // Main entry point to browser window
 
+#include <chrono>
+#include <functional>
 #include <iostream>
+#include <thread>
 
 #include <gflags/gflags.h>
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 
+#include "absl/strings/str_format.h"
+
 #include "dom.h"
 #include "layout.h"
 #include "parse/css.h"
 #include "parse/html.h"
+#include "parse/scan.h"
+#include "render/headless.h"
+#include "render/image.h"
+#include "render/glyph_atlas.h"
 #include "render/paint.h"
+#include "render/raster.h"
 #include "render/text.h"
+#include "render/tiles.h"
 #include "style.h"
+#include "trace.h"
 #include "util.h"
 
 DEFINE_string(html_file, "examples/demo.html", "HTML file to load");
 DEFINE_string(css_file, "examples/demo.css", "CSS file to load");
 DEFINE_int32(window_width, 1000, "initial width of window");
 DEFINE_int32(window_height, 800, "initial height of window");
+DEFINE_bool(verify_style_sharing, false,
+            "check every style sharing cache hit against a full match");
+DEFINE_int32(benchmark_replay_frames, 0,
+             "replay the initial display list this many times and report the "
+             "average frame time");
+DEFINE_int32(benchmark_scroll_frames, 0,
+             "scroll from the top of the page to the bottom and back in this "
+             "many frames each way, and report the average frame time");
+DEFINE_int32(image_cache_mb, 64,
+             "megabytes of decoded images to keep between paints");
+DEFINE_int32(image_decode_threads, 2,
+             "threads to decode images on, or 0 to decode them when first "
+             "painted");
+DEFINE_bool(batch_shapes, true,
+            "draw rects and borders in as few batched draw calls as paint "
+            "order allows");
+DEFINE_bool(batch_text, true,
+            "draw the glyphs of many lines with one draw call per font and "
+            "size, rather than a draw call per line");
+DEFINE_string(raster, "sfml",
+              "how headless mode paints: 'sfml' draws with OpenGL into a "
+              "render texture, 'software' on the CPU into memory");
+DEFINE_bool(headless, false,
+            "render the page offscreen and write it to --output_png instead "
+            "of opening a window");
+DEFINE_string(output_png, "out.png", "PNG file to write in headless mode");
+DEFINE_bool(full_page, false,
+            "in headless mode, render the whole height of the page rather "
+            "than the top --window_height pixels");
+DEFINE_string(reference_png, "",
+              "in headless mode, compare the rendered page with this PNG");
+DEFINE_double(max_diff_percent, 0,
+              "percentage of pixels that may differ from --reference_png "
+              "before headless mode fails");
+DEFINE_string(log_level, "info",
+              "least severe messages to log: debug, info, warn or error");
+DEFINE_bool(async_log, false,
+            "write log messages from a background thread, so logging doesn't "
+            "block the pipeline on output");
+DEFINE_double(frame_budget_ms, 16,
+              "least time between frames in the window; input that arrives "
+              "sooner is coalesced into the next frame");
+DEFINE_string(trace_file, "",
+              "if set, write a Chrome trace of the page load to this file, "
+              "for chrome://tracing or Perfetto");
 
 namespace {
 
-void renderWindow(int width, int height, const style::StyledNode &sn,
-                  sf::RenderWindow *window) {
+// Lays out the layout tree for a viewport of the given size.
+void layoutWindow(int width, int height, layout::LayoutElement *layout_root) {
   layout::Dimensions viewport;
   viewport.content.width = width;
   viewport.content.height = height;
-  // Create layout tree for the specified viewport dimensions.
-  std::unique_ptr<layout::LayoutElement> layout_root =
-      layout::layout_tree(sn, viewport);
-  // Paint to window.
-  paint(*layout_root, viewport.content, window);
+  // Lay the existing tree out again in place. Subtrees that don't depend on
+  // the viewport width keep their previous layout.
+  auto layout_start = std::chrono::steady_clock::now();
+  layout::resetLayoutStats();
+  layout::relayout(layout_root, viewport);
+  std::chrono::duration<double, std::milli> layout_time =
+      std::chrono::steady_clock::now() - layout_start;
+  const layout::LayoutStats &layout_stats = layout::getLayoutStats();
+  logger::info(absl::StrFormat(
+      "Layout took %.2fms: %d boxes laid out, %d subtrees reused",
+      layout_time.count(), layout_stats.boxes_laid_out,
+      layout_stats.subtrees_reused));
+}
+
+// Records the display list for the current layout of the tree.
+void recordDisplayList(layout::LayoutElement *layout_root,
+                       DisplayList *display_list) {
+  auto record_start = std::chrono::steady_clock::now();
+  buildDisplayList(*layout_root, display_list);
+  std::chrono::duration<double, std::milli> record_time =
+      std::chrono::steady_clock::now() - record_start;
+  logger::info(absl::StrFormat("Recorded %d paint ops in %.2fms",
+                               display_list->get_ops().size(),
+                               record_time.count()));
+  LOG_DEBUG(display_list->toLogStr());
 }
 
-int windowLoop(const style::StyledNode &sn) {
+// Replays the display list `frames` times with `replay_frame` without
+// presenting, so the timing covers drawing alone and not the tree walk that
+// recorded the list.
+void benchmarkReplay(const DisplayList &display_list, int frames,
+                     const std::string &backend,
+                     const std::function<void()> &replay_frame) {
+  image_render::ImageCache *image_cache =
+      image_render::ImageCache::getInstance();
+  resetPaintStats();
+  auto replay_start = std::chrono::steady_clock::now();
+  for (int i = 0; i < frames; i++) {
+    replay_frame();
+    image_cache->endFrame();
+  }
+  std::chrono::duration<double, std::milli> replay_time =
+      std::chrono::steady_clock::now() - replay_start;
+  const PaintStats &paint_stats = getPaintStats();
+  logger::info(absl::StrFormat(
+      "Replayed %d of %d paint ops %d times with %s: %.3fms (%.1f fps) and %d "
+      "draw calls per frame (%s shapes, %s text)",
+      paint_stats.ops_replayed / frames, display_list.get_ops().size(),
+      frames, backend, replay_time.count() / frames,
+      frames * 1000 / replay_time.count(), paint_stats.draw_calls / frames,
+      FLAGS_batch_shapes ? "batched" : "unbatched",
+      FLAGS_batch_text ? "batched" : "unbatched"));
+  logger::info(absl::StrFormat(
+      "Image cache: %d hits, %d misses, %d evictions, %d images in %d bytes",
+      image_cache->stats.hits, image_cache->stats.misses,
+      image_cache->stats.evictions, image_cache->get_count(),
+      image_cache->get_bytes()));
+}
+
+// Scroll position, in pixels from the top of the page.
+class Scroller {
+  int scroll_y_ = 0;
+  int max_scroll_y_ = 0;
+
+ public:
+  // Keeps the position within a page of `page_height` in a window of
+  // `window_height`.
+  void setBounds(int page_height, int window_height) {
+    max_scroll_y_ = std::max(0, page_height - window_height);
+    scrollTo(scroll_y_);
+  }
+  // Returns true if the position changed.
+  bool scrollTo(int y) {
+    int clamped = std::max(0, std::min(max_scroll_y_, y));
+    bool changed = clamped != scroll_y_;
+    scroll_y_ = clamped;
+    return changed;
+  }
+  bool scrollBy(int dy) { return scrollTo(scroll_y_ + dy); }
+  int get_scroll_y() const { return scroll_y_; }
+  int get_max_scroll_y() const { return max_scroll_y_; }
+};
+
+// Pixels scrolled by an arrow key or one step of the mouse wheel.
+const int kScrollStep = 40;
+
+// Returns how far a key scrolls a window of `window_height`, or 0 if it
+// doesn't.
+int keyScrollDelta(sf::Keyboard::Key key, int window_height,
+                   const Scroller &scroller) {
+  switch (key) {
+    case sf::Keyboard::Up:
+      return -kScrollStep;
+    case sf::Keyboard::Down:
+      return kScrollStep;
+    case sf::Keyboard::PageUp:
+      return -std::max(kScrollStep, window_height - kScrollStep);
+    case sf::Keyboard::PageDown:
+    case sf::Keyboard::Space:
+      return std::max(kScrollStep, window_height - kScrollStep);
+    case sf::Keyboard::Home:
+      return -scroller.get_scroll_y();
+    case sf::Keyboard::End:
+      return scroller.get_max_scroll_y() - scroller.get_scroll_y();
+    default:
+      return 0;
+  }
+}
+
+int pageHeight(const layout::LayoutElement &layout_root) {
+  layout::Rect page = layout_root.dimensions.marginBox();
+  return page.y + page.height;
+}
+
+// Scrolls from the top of the page to the bottom in `frames` steps and back,
+// reporting frame times while tiles are first rasterized and once they are
+// cached.
+void benchmarkScroll(const DisplayList &display_list, int page_height,
+                     int frames, tiles::TileCache *tile_cache,
+                     sf::RenderWindow *window) {
+  Scroller scroller;
+  scroller.setBounds(page_height, window->getSize().y);
+  for (int pass = 0; pass < 2; pass++) {
+    bool down = pass == 0;
+    tile_cache->resetStats();
+    auto scroll_start = std::chrono::steady_clock::now();
+    for (int i = 0; i <= frames; i++) {
+      int y = static_cast<long>(scroller.get_max_scroll_y()) * i / frames;
+      scroller.scrollTo(down ? y : scroller.get_max_scroll_y() - y);
+      window->clear(sf::Color::Black);
+      tile_cache->composite(display_list, window, scroller.get_scroll_y(),
+                            FLAGS_batch_shapes, FLAGS_batch_text);
+      window->display();
+      image_render::ImageCache::getInstance()->endFrame();
+    }
+    std::chrono::duration<double, std::milli> scroll_time =
+        std::chrono::steady_clock::now() - scroll_start;
+    const tiles::TileStats &stats = tile_cache->get_stats();
+    logger::info(absl::StrFormat(
+        "Scrolled %s %dpx in %d frames: %.3fms per frame, %d tiles "
+        "rasterized, %d composited",
+        down ? "down" : "up", scroller.get_max_scroll_y(), stats.frames,
+        scroll_time.count() / stats.frames, stats.tiles_rasterized,
+        stats.tiles_drawn));
+  }
+}
+
+// Input gathered from the events of one frame.
+struct FrameInput {
+  // Resized events, and the window size once they are applied.
+  int resizes = 0;
+  unsigned width = 0;
+  unsigned height = 0;
+  // Whether the page hasn't been laid out for the last Resized event yet.
+  bool resize_pending = false;
+  // Scroll events, and where they leave the page. Each event moves on from
+  // where the events before it left it, within the bounds of the window size
+  // at that point.
+  int scrolls = 0;
+  Scroller scroller;
+};
+
+// Counts for the window's event loop, logged when it closes.
+struct EventLoopStats {
+  long events = 0;
+  long frames = 0;
+  long resize_frames = 0;
+  long scroll_frames = 0;
+  // Times the loop blocked in waitEvent.
+  long waits = 0;
+  // Events folded into a later event of the same kind in the same frame.
+  long resizes_coalesced = 0;
+  long scrolls_coalesced = 0;
+  // Events the browser doesn't handle, such as mouse moves.
+  long ignored = 0;
+};
+
+int windowLoop(const style::StyledNode &sn, dom::Document *document,
+               std::chrono::steady_clock::time_point start) {
   // Create browser window.
   std::unique_ptr<sf::RenderWindow> window(new sf::RenderWindow());
   window->create(sf::VideoMode(FLAGS_window_width, FLAGS_window_height),
                  "Toy Browser", sf::Style::Close | sf::Style::Resize);
   window->setPosition(sf::Vector2i(0, 0));
   window->clear(sf::Color::Black);
-  // Render initial window contents.
-  renderWindow(FLAGS_window_width, FLAGS_window_height, sn, window.get());
+  // Build the layout tree once. Resizing lays it out again in place.
+  layout::LayoutElement *layout_root =
+      layout::build_layout_tree(sn, document->get_layout_arena());
+  logger::info(absl::StrFormat(
+      "Built layout tree with %d boxes",
+      document->get_layout_arena()->get_stats().objects));
+  // Render initial window contents. The display list is recorded again only
+  // when the layout changes, and it is only replayed into tiles that haven't
+  // been rasterized yet.
+  unsigned layout_width = FLAGS_window_width;
+  layoutWindow(FLAGS_window_width, FLAGS_window_height, layout_root);
+  DisplayList display_list;
+  recordDisplayList(layout_root, &display_list);
+  tiles::TileCache tile_cache;
+  Scroller scroller;
+  scroller.setBounds(pageHeight(*layout_root), FLAGS_window_height);
+  if (FLAGS_benchmark_replay_frames > 0) {
+    layout::Rect visible;
+    visible.width = FLAGS_window_width;
+    visible.height = FLAGS_window_height;
+    benchmarkReplay(display_list, FLAGS_benchmark_replay_frames, "sfml",
+                    [&]() {
+                      window->clear(sf::Color::Black);
+                      display_list.replay(window.get(), visible,
+                                          FLAGS_batch_shapes,
+                                          FLAGS_batch_text);
+                    });
+  }
+  if (FLAGS_benchmark_scroll_frames > 0) {
+    benchmarkScroll(display_list, pageHeight(*layout_root),
+                    FLAGS_benchmark_scroll_frames, &tile_cache, window.get());
+  }
+  // Lays the page out for the size of the frame's last Resized event.
+  auto applyResize = [&](FrameInput *input) {
+    // Keep drawing at one pixel per pixel rather than stretching.
+    window->setView(
+        sf::View(sf::FloatRect(0, 0, input->width, input->height)));
+    // Layout only depends on the viewport width.
+    if (input->width != layout_width) {
+      layout_width = input->width;
+      layoutWindow(input->width, input->height, layout_root);
+      recordDisplayList(layout_root, &display_list);
+      tile_cache.clear();
+    }
+    scroller.setBounds(pageHeight(*layout_root), input->height);
+    input->scroller.setBounds(pageHeight(*layout_root), input->height);
+    input->resize_pending = false;
+  };
+  auto repaint = [&]() {
+    window->clear(sf::Color::Black);
+    tile_cache.composite(display_list, window.get(), scroller.get_scroll_y(),
+                         FLAGS_batch_shapes, FLAGS_batch_text);
+    window->display();
+    image_render::ImageCache::getInstance()->endFrame();
+  };
+  image_render::ImageCache *image_cache =
+      image_render::ImageCache::getInstance();
+  // Images whose headers couldn't be read are sized once they have been
+  // decoded, which means laying the page out again. Returns true if it was.
+  std::size_t image_sizes = image_cache->get_size_count();
+  auto sizeDecodedImages = [&]() {
+    if (image_cache->get_size_count() == image_sizes) {
+      return false;
+    }
+    image_sizes = image_cache->get_size_count();
+    if (!layout_root->sizeDecodedImages()) {
+      return false;
+    }
+    layoutWindow(layout_width, window->getSize().y, layout_root);
+    recordDisplayList(layout_root, &display_list);
+    tile_cache.clear();
+    scroller.setBounds(pageHeight(*layout_root), window->getSize().y);
+    return true;
+  };
+  repaint();
+  std::chrono::duration<double, std::milli> first_paint_time =
+      std::chrono::steady_clock::now() - start;
+  logger::info(absl::StrFormat("First paint after %.2fms, %d images decoding",
+                               first_paint_time.count(),
+                               image_cache->get_pending_count()));
+  // Resize, scroll and image work waits for the next frame, so bursts of
+  // input cost one layout and one paint each frame rather than one per event.
+  const auto frame_budget = std::chrono::duration_cast<
+      std::chrono::steady_clock::duration>(
+      std::chrono::duration<double, std::milli>(FLAGS_frame_budget_ms));
+  auto last_frame = std::chrono::steady_clock::now();
+  EventLoopStats stats;
+  double total_resize_ms = 0;
+  double total_scroll_ms = 0;
   // Run the main event loop as long as the window is open.
   while (window->isOpen()) {
     sf::Event event;
-    while (window->pollEvent(event)) {
+    bool have_event;
+    // Only decoding images change the page without an event, so with none
+    // pending sleep until the next event instead of polling.
+    if (image_cache->get_pending_count() == 0) {
+      stats.waits++;
+      have_event = window->waitEvent(event);
+    } else {
+      have_event = window->pollEvent(event);
+    }
+    // SFML events carry no timestamps, so latency is measured from when the
+    // first event of the frame was read.
+    auto received = std::chrono::steady_clock::now();
+    // Input that arrives while this sleeps joins the frame. After an idle
+    // wait the deadline has passed and this doesn't sleep at all.
+    std::this_thread::sleep_until(last_frame + frame_budget);
+    auto frame_start = std::chrono::steady_clock::now();
+    last_frame = frame_start;
+    FrameInput input;
+    input.width = window->getSize().x;
+    input.height = window->getSize().y;
+    input.scroller = scroller;
+    for (; have_event; have_event = window->pollEvent(event)) {
+      stats.events++;
       switch (event.type) {
         case sf::Event::Closed:
           window->close();
           break;
 
-        case sf::Event::KeyPressed:
-          logger::debug("keypress: " + std::to_string(event.key.code));
+        case sf::Event::MouseButtonPressed: {
+          // The click lands on the page as the events before it left it.
+          if (input.resize_pending) {
+            applyResize(&input);
+          }
+          const layout::LayoutElement *box = display_list.hitTest(
+              event.mouseButton.x,
+              event.mouseButton.y + input.scroller.get_scroll_y());
+          if (box != nullptr) {
+            layout::Rect r = box->dimensions.borderBox();
+            LOG_DEBUG(absl::StrFormat(
+                "Clicked box at x=%d, y=%d, width=%d, height=%d", r.x, r.y,
+                r.width, r.height));
+          }
+          break;
+        }
+
+        case sf::Event::MouseWheelScrolled:
+          if (event.mouseWheelScroll.wheel == sf::Mouse::VerticalWheel) {
+            input.scrolls++;
+            input.scroller.scrollBy(-event.mouseWheelScroll.delta *
+                                    kScrollStep);
+          }
           break;
 
+        case sf::Event::KeyPressed: {
+          LOG_DEBUG("keypress: " + std::to_string(event.key.code));
+          int dy =
+              keyScrollDelta(event.key.code, input.height, input.scroller);
+          if (dy != 0) {
+            input.scrolls++;
+            input.scroller.scrollBy(dy);
+          }
+          break;
+        }
+
         case sf::Event::Resized:
-          logger::debug("new width: " + std::to_string(event.size.width));
-          logger::debug("new height: " + std::to_string(event.size.height));
-          window->clear(sf::Color::Black);
-          renderWindow(event.size.width, event.size.height, sn, window.get());
+          LOG_DEBUG(absl::StrFormat("new size: %dx%d", event.size.width,
+                                    event.size.height));
+          // Only the last size in a frame is laid out, unless a click needs
+          // the layout sooner.
+          input.resizes++;
+          input.resize_pending = true;
+          input.width = event.size.width;
+          input.height = event.size.height;
+          // Until then scrolling is bounded by the current page height.
+          input.scroller.setBounds(pageHeight(*layout_root), input.height);
           break;
 
         case sf::Event::TextEntered:
           if (event.text.unicode < 128) {
-            logger::debug(
-                "ASCII character typed: " +
-                std::to_string(static_cast<char>(event.text.unicode)));
+            LOG_DEBUG("ASCII character typed: " +
+                      std::to_string(static_cast<char>(event.text.unicode)));
           }
           break;
 
         default:
+          stats.ignored++;
           break;
       }
     }
+    if (!window->isOpen()) {
+      break;
+    }
+    bool dirty = false;
+    if (input.resizes > 0) {
+      stats.resizes_coalesced += input.resizes - 1;
+      if (input.resize_pending) {
+        applyResize(&input);
+      }
+      dirty = true;
+    }
+    // Scroll once to where all the scroll input in this frame left the page.
+    long rasterized = tile_cache.get_stats().tiles_rasterized;
+    bool scrolled =
+        input.scrolls > 0 && scroller.scrollTo(input.scroller.get_scroll_y());
+    if (input.scrolls > 0) {
+      stats.scrolls_coalesced += input.scrolls - 1;
+    }
+    dirty = dirty || scrolled;
+    // Repaint when images finish decoding, so they replace their
+    // placeholders.
+    bool images_painted = image_cache->collect() > 0;
+    if (images_painted) {
+      for (const PaintOp &op : display_list.get_ops()) {
+        if (op.type == PaintOpType::Image) {
+          tile_cache.invalidate(op.rect);
+        }
+      }
+      dirty = true;
+    }
+    dirty = sizeDecodedImages() || dirty;
+    if (!dirty) {
+      continue;
+    }
+    repaint();
+    stats.frames++;
+    auto frame_end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> frame_time =
+        frame_end - frame_start;
+    if (input.resizes > 0) {
+      // Latency includes the time spent waiting for the frame.
+      std::chrono::duration<double, std::milli> resize_latency =
+          frame_end - received;
+      stats.resize_frames++;
+      total_resize_ms += frame_time.count();
+      logger::info(absl::StrFormat(
+          "Resize to %dx%d took %.2fms (%.2fms average over %d resizes), "
+          "%.2fms after input (%d resize events)",
+          input.width, input.height, frame_time.count(),
+          total_resize_ms / stats.resize_frames, stats.resize_frames,
+          resize_latency.count(), input.resizes));
+    }
+    if (scrolled) {
+      stats.scroll_frames++;
+      total_scroll_ms += frame_time.count();
+      LOG_DEBUG(absl::StrFormat(
+          "Scrolled to %d in %.2fms (%.2fms average over %d frames), %d tiles "
+          "rasterized",
+          scroller.get_scroll_y(), frame_time.count(),
+          total_scroll_ms / stats.scroll_frames, stats.scroll_frames,
+          tile_cache.get_stats().tiles_rasterized - rasterized));
+    }
+    if (images_painted && image_cache->get_pending_count() == 0) {
+      std::chrono::duration<double, std::milli> images_time =
+          frame_end - start;
+      logger::info(absl::StrFormat("All images painted after %.2fms",
+                                   images_time.count()));
+    }
   }
+  logger::info(absl::StrFormat(
+      "Event loop: %d events in %d frames after %d waits, %d resizes and %d "
+      "scrolls coalesced, %d events ignored",
+      stats.events, stats.frames, stats.waits, stats.resizes_coalesced,
+      stats.scrolls_coalesced, stats.ignored));
   return 0;
 }
+
+// Renders the page offscreen and writes it to --output_png, comparing it with
+// --reference_png if one is given. Returns the exit code.
+int renderHeadless(const style::StyledNode &sn, dom::Document *document,
+                   std::chrono::steady_clock::time_point start) {
+  layout::LayoutElement *layout_root =
+      layout::build_layout_tree(sn, document->get_layout_arena());
+  layoutWindow(FLAGS_window_width, FLAGS_window_height, layout_root);
+  DisplayList display_list;
+  recordDisplayList(layout_root, &display_list);
+  // Nothing is shown before the PNG is written, so paint every image rather
+  // than its placeholder.
+  image_render::ImageCache::getInstance()->waitForPending();
+  // Images whose headers couldn't be read can be sized now.
+  if (layout_root->sizeDecodedImages()) {
+    layoutWindow(FLAGS_window_width, FLAGS_window_height, layout_root);
+    recordDisplayList(layout_root, &display_list);
+  }
+  layout::Rect area;
+  area.width = FLAGS_window_width;
+  area.height = FLAGS_window_height;
+  bool software = FLAGS_raster == "software";
+  if (FLAGS_full_page) {
+    area.height = std::max(area.height, pageHeight(*layout_root));
+    // Only textures are limited in size.
+    int max_height = software ? area.height : sf::Texture::getMaximumSize();
+    if (area.height > max_height) {
+      logger::warn(absl::StrFormat(
+          "Page is %dpx tall, rendering the top %dpx", area.height,
+          max_height));
+      area.height = max_height;
+    }
+  }
+  headless::Offscreen offscreen(software);
+  if (!offscreen.create(area)) {
+    return 1;
+  }
+  if (FLAGS_benchmark_replay_frames > 0) {
+    benchmarkReplay(
+        display_list, FLAGS_benchmark_replay_frames,
+        software ? absl::StrFormat("software (%s spans)",
+                                   raster::getImplementationName())
+                 : "sfml",
+        [&]() {
+          offscreen.paint(display_list, FLAGS_batch_shapes, FLAGS_batch_text);
+        });
+  }
+  offscreen.paint(display_list, FLAGS_batch_shapes, FLAGS_batch_text);
+  sf::Image image = offscreen.capture();
+  if (!image.saveToFile(FLAGS_output_png)) {
+    logger::error("Unable to write " + FLAGS_output_png);
+    return 1;
+  }
+  std::chrono::duration<double, std::milli> render_time =
+      std::chrono::steady_clock::now() - start;
+  logger::info(absl::StrFormat("Wrote %dx%d render to %s after %.2fms",
+                               area.width, area.height, FLAGS_output_png,
+                               render_time.count()));
+  if (FLAGS_reference_png.empty()) {
+    return 0;
+  }
+  sf::Image reference;
+  if (!reference.loadFromFile(FLAGS_reference_png)) {
+    logger::error("Unable to read " + FLAGS_reference_png);
+    return 1;
+  }
+  headless::ImageDiff diff = headless::compareImages(image, reference);
+  if (diff.size_mismatch) {
+    logger::error(absl::StrFormat("Render is %dx%d but %s is %dx%d",
+                                  area.width, area.height, FLAGS_reference_png,
+                                  reference.getSize().x,
+                                  reference.getSize().y));
+    return 1;
+  }
+  logger::info(absl::StrFormat("%d of %d pixels (%.3f%%) differ from %s",
+                               diff.differing_pixels, diff.total_pixels,
+                               diff.differingPercent(), FLAGS_reference_png));
+  return diff.differingPercent() > FLAGS_max_diff_percent ? 1 : 0;
+}
 }  // namespace
 
 int main(int argc, char **argv) {
   gflags::ParseCommandLineFlags(&argc, &argv, true);
+  logger::Level log_level;
+  if (!logger::parseLevel(FLAGS_log_level, &log_level)) {
+    logger::error("Unknown --log_level: " + FLAGS_log_level);
+    return 1;
+  }
+  logger::setLevel(log_level);
+  if (!FLAGS_trace_file.empty()) {
+    trace::enable();
+    trace::setThreadName("main");
+  }
+  const auto start = std::chrono::steady_clock::now();
 
-  // Parse HTML and CSS files.
-  const std::string source = io::readFile(FLAGS_html_file);
-  std::unique_ptr<dom::Node> root = html_parser::parseHtml(source);
-  const std::string css = io::readFile(FLAGS_css_file);
-  const std::unique_ptr<css::StyleSheet const> stylesheet = css::parseCss(css);
-
-  // Initialize font registry singleton.
+  // Initialize font registry and image cache singletons.
   text_render::FontRegistry *registry =
       text_render::FontRegistry::getInstance();
+  image_render::ImageCache *image_cache =
+      image_render::ImageCache::getInstance();
+  image_cache->set_budget_bytes(std::size_t(FLAGS_image_cache_mb) << 20);
+  image_cache->set_decode_threads(FLAGS_image_decode_threads);
+  if (FLAGS_raster != "sfml" && FLAGS_raster != "software") {
+    logger::error("Unknown --raster: " + FLAGS_raster);
+    return 1;
+  }
+  // Started once nothing can fail early, so every buffered message is written
+  // by stopAsync() below.
+  if (FLAGS_async_log) {
+    logger::startAsync();
+  }
+  // Load the bundled fonts in the background while the page is parsed and
+  // styled.
+  registry->preload();
+  // The software rasterizer draws images from their pixels.
+  image_cache->set_keep_pixels(FLAGS_headless && FLAGS_raster == "software");
+
+  // Parse HTML and CSS files. Images start loading as soon as the parser
+  // reaches them.
+  auto parse_start = std::chrono::steady_clock::now();
+  std::unique_ptr<io::MappedFile> source(new io::MappedFile(FLAGS_html_file));
+  const std::size_t html_bytes = source->get_contents().size();
+  std::unique_ptr<dom::Document> document = html_parser::parseHtml(
+      std::move(source), [image_cache](absl::string_view src) {
+        image_cache->request(image_render::resolvePath(std::string(src)));
+      });
+  std::chrono::duration<double> html_time =
+      std::chrono::steady_clock::now() - parse_start;
+  parse_start = std::chrono::steady_clock::now();
+  // The stylesheet copies what it keeps, so the CSS source can be unmapped as
+  // soon as it is parsed.
+  std::unique_ptr<io::MappedFile> css_source(
+      new io::MappedFile(FLAGS_css_file));
+  const std::unique_ptr<css::StyleSheet const> stylesheet =
+      css::parseCss(css_source->get_contents());
+  css_source.reset();
+  std::chrono::duration<double> css_time =
+      std::chrono::steady_clock::now() - parse_start;
+  logger::info(absl::StrFormat(
+      "Parsed %d bytes of HTML in %.2fms (%.1f MB/s, %s scanner), CSS in "
+      "%.2fms",
+      html_bytes, html_time.count() * 1000,
+      html_bytes / 1e6 / html_time.count(), scan::getImplementationName(),
+      css_time.count() * 1000));
 
   // Align styles with DOM nodes.
-  std::unique_ptr<style::StyledNode> styled_node =
-      style::styleTree(*root, stylesheet, style::PropertyMap());
+  auto style_start = std::chrono::steady_clock::now();
+  style::StyleSharingCache style_cache(FLAGS_verify_style_sharing);
+  style::StyledNode *styled_node =
+      style::styleTree(document->get_root(), stylesheet, style::PropertyMap(),
+                       document->get_arena(), &style_cache);
+  std::chrono::duration<double, std::micro> style_time =
+      std::chrono::steady_clock::now() - style_start;
+  const style::MatchStats &match_stats = style::getMatchStats();
+  logger::info(absl::StrFormat(
+      "Selector matching probed %d rules for %d elements (%.1f per element)",
+      match_stats.rules_probed, match_stats.elements,
+      match_stats.probedPerElement()));
+  logger::info(absl::StrFormat(
+      "Styled %d elements in %.2fms (%.2fus per element)",
+      match_stats.elements, style_time.count() / 1000,
+      style_time.count() / std::max(match_stats.elements, 1L)));
+  logger::info(absl::StrFormat(
+      "Style sharing cache: %d hits, %d misses, %d mismatches",
+      style_cache.stats.hits, style_cache.stats.misses,
+      style_cache.stats.mismatches));
+  const arena::Arena::Stats &arena_stats = document->get_arena()->get_stats();
+  logger::info(absl::StrFormat(
+      "Document arena: %d DOM and styled nodes, %d bytes in %d blocks",
+      arena_stats.objects, arena_stats.bytes, arena_stats.blocks));
 
-  // Run main browser window loop.
-  windowLoop(*styled_node);
+  // Run main browser window loop, or render the page once without a window.
+  int status = FLAGS_headless
+                   ? renderHeadless(*styled_node, document.get(), start)
+                   : windowLoop(*styled_node, document.get(), start);
 
-  // Delete styled node and clear font registry.
-  styled_node.reset();
+  // Free the document's DOM, styled and layout trees, and clear font registry,
+  // image cache and glyph atlas.
+  auto teardown_start = std::chrono::steady_clock::now();
+  document.reset();
+  std::chrono::duration<double, std::milli> teardown_time =
+      std::chrono::steady_clock::now() - teardown_start;
+  logger::info(
+      absl::StrFormat("Document teardown took %.2fms", teardown_time.count()));
   registry->clear();
-  return 0;
+  image_cache->clear();
+  raster::GlyphAtlas::getInstance()->clear();
+  // Clearing the image cache stopped the decoder threads, so every span has
+  // been recorded.
+  if (!FLAGS_trace_file.empty() && !trace::write(FLAGS_trace_file)) {
+    status = 1;
+  }
+  logger::stopAsync();
+  return status;
 }
@@ -2,161 +2,212 @@
 
 #include "css.h"
 
+#include <algorithm>
 #include <tuple>
 
 #include "absl/strings/ascii.h"
 #include "absl/strings/str_format.h"
 
 #include "../constants.h"
+#include "../trace.h"
 #include "../util.h"
 
 namespace css {
 
 namespace {
-bool validSelectorChar(char c) { return c != '{' && c != '/' && c != ' '; }
-bool validPropertyChar(char c) { return isalnum(c) || c == '-' || c == '_'; }
-bool validValueChar(char c) { return c != ';' && c != '}'; }
-}  // namespace
-
-std::vector<Rule> getDefaultTagRules() {
+// Characters that end a selector identifier.
+const scan::CharSet kSelectorStop("{/ \t\n\v\f\r");
+// Characters that may appear in a property name.
+const scan::CharSet kPropertyChars(
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_");
+// Characters that end a declaration value.
+const scan::CharSet kValueStop(";}");
+
+// The user-agent stylesheet, as a static table of single-tag rules. Unused
+// declaration slots are left null.
+struct DefaultDeclaration {
+  const char* name;
+  const char* value;
+};
+
+struct DefaultRule {
+  const char* tag;
+  DefaultDeclaration declarations[4];
+};
+
+constexpr DefaultRule DEFAULT_TAG_RULES[] = {
+    {constants::html_tags::HTML,
+     {{constants::css_properties::FONT_SIZE, "12"}}},
+    // h1, 30px
+    {constants::html_tags::H1,
+     {{constants::css_properties::FONT_SIZE, "30"},
+      {constants::css_properties::FONT_WEIGHT,
+       constants::css_font_values::BOLD},
+      {constants::css_properties::MARGIN_BOTTOM, "10"},
+      {constants::css_properties::MARGIN_TOP, "10"}}},
+    // h2, 24px
+    {constants::html_tags::H2,
+     {{constants::css_properties::FONT_SIZE, "24"},
+      {constants::css_properties::FONT_WEIGHT, "bold"},
+      {constants::css_properties::MARGIN_BOTTOM, "10"},
+      {constants::css_properties::MARGIN_TOP, "10"}}},
+    // h3, 18px
+    {constants::html_tags::H3,
+     {{constants::css_properties::FONT_SIZE, "18"},
+      {constants::css_properties::FONT_WEIGHT, "bold"},
+      {constants::css_properties::MARGIN_BOTTOM, "10"},
+      {constants::css_properties::MARGIN_TOP, "10"}}},
+    // h4, 14px
+    {constants::html_tags::H4,
+     {{constants::css_properties::FONT_SIZE, "14"},
+      {constants::css_properties::FONT_WEIGHT, "bold"},
+      {constants::css_properties::MARGIN_BOTTOM, "10"},
+      {constants::css_properties::MARGIN_TOP, "10"}}},
+    {constants::html_tags::UL,
+     {{constants::css_properties::MARGIN_BOTTOM, "1em"},
+      {constants::css_properties::MARGIN_TOP, "1em"}}},
+    {constants::html_tags::LI,
+     {{constants::css_properties::PADDING_LEFT, "20"}}},
+    {constants::html_tags::BULLET,
+     {{constants::css_properties::DISPLAY, "inline"},
+      {constants::css_properties::HEIGHT, "1em"},
+      {constants::css_properties::WIDTH, "1em"}}},
+    {constants::html_tags::P,
+     {{constants::css_properties::MARGIN_BOTTOM, "10"},
+      {constants::css_properties::MARGIN_TOP, "10"}}},
+    {constants::html_tags::A,
+     {{constants::css_properties::TEXT_DECORATION,
+       constants::css_font_values::UNDERLINE},
+      {constants::css_properties::COLOR, "#0000EE"}}},
+    {constants::html_tags::HR,
+     {{constants::css_properties::HEIGHT, "1"},
+      {constants::css_properties::BACKGROUND_COLOR, "#000000"}}},
+    // Font styling tags
+    {constants::html_tags::EM,
+     {{constants::css_properties::FONT_STYLE,
+       constants::css_font_values::ITALIC}}},
+    {constants::html_tags::BOLD,
+     {{constants::css_properties::FONT_WEIGHT,
+       constants::css_font_values::BOLD}}},
+};
+
+std::vector<Rule> buildDefaultTagRules() {
   std::vector<Rule> rules;
+  for (auto const& default_rule : DEFAULT_TAG_RULES) {
+    std::vector<Declaration> declarations;
+    for (auto const& d : default_rule.declarations) {
+      if (d.name != nullptr) {
+        declarations.push_back(Declaration(d.name, d.value));
+      }
+    }
+    rules.push_back(Rule({Selector(default_rule.tag)}, declarations));
+  }
+  return rules;
+}
 
-  Rule html({Selector(constants::html_tags::HTML)},
-            {Declaration(constants::css_properties::FONT_SIZE, "12")});
-  rules.push_back(html);
-
-  // h1, 30px
-  std::vector<Declaration> h1_declarations = {
-      Declaration(constants::css_properties::FONT_SIZE, "30"),
-      Declaration(constants::css_properties::FONT_WEIGHT,
-                  constants::css_font_values::BOLD),
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "10"),
-      Declaration(constants::css_properties::MARGIN_TOP, "10"),
-  };
-  Rule h1({Selector(constants::html_tags::H1)}, h1_declarations);
-  rules.push_back(h1);
-
-  // h2, 24px
-  std::vector<Declaration> h2_declarations = {
-      Declaration(constants::css_properties::FONT_SIZE, "24"),
-      Declaration(constants::css_properties::FONT_WEIGHT, "bold"),
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "10"),
-      Declaration(constants::css_properties::MARGIN_TOP, "10"),
-  };
-  Rule h2({Selector(constants::html_tags::H2)}, h2_declarations);
-  rules.push_back(h2);
-
-  // h3, 18px
-  std::vector<Declaration> h3_declarations = {
-      Declaration(constants::css_properties::FONT_SIZE, "18"),
-      Declaration(constants::css_properties::FONT_WEIGHT, "bold"),
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "10"),
-      Declaration(constants::css_properties::MARGIN_TOP, "10"),
-  };
-  Rule h3({Selector(constants::html_tags::H3)}, h3_declarations);
-  rules.push_back(h3);
-
-  // h4, 14px
-  std::vector<Declaration> h4_declarations = {
-      Declaration(constants::css_properties::FONT_SIZE, "14"),
-      Declaration(constants::css_properties::FONT_WEIGHT, "bold"),
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "10"),
-      Declaration(constants::css_properties::MARGIN_TOP, "10"),
-  };
-  Rule h4({Selector(constants::html_tags::H4)}, h4_declarations);
-  rules.push_back(h4);
-
-  std::vector<Declaration> ul_declarations = {
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "1em"),
-      Declaration(constants::css_properties::MARGIN_TOP, "1em"),
-  };
-  Rule ul({Selector(constants::html_tags::UL)}, ul_declarations);
-  rules.push_back(ul);
-
-  std::vector<Declaration> li_declarations = {
-      Declaration(constants::css_properties::PADDING_LEFT, "20"),
-  };
-  Rule li({Selector(constants::html_tags::LI)}, li_declarations);
-  rules.push_back(li);
-
-  std::vector<Declaration> bullet_declarations = {
-      Declaration(constants::css_properties::DISPLAY, "inline"),
-      Declaration(constants::css_properties::HEIGHT, "1em"),
-      Declaration(constants::css_properties::WIDTH, "1em"),
-  };
-  Rule bullet({Selector("bullet")}, bullet_declarations);
-  rules.push_back(bullet);
+// Concatenates the user-agent rules and the author rules.
+std::vector<Rule> cascadeRules(const std::vector<Rule>& author_rules) {
+  std::vector<Rule> all_rules = getDefaultTagRules();
+  all_rules.insert(all_rules.end(), author_rules.begin(), author_rules.end());
+  return all_rules;
+}
+}  // namespace
 
-  std::vector<Declaration> p_declarations = {
-      Declaration(constants::css_properties::MARGIN_BOTTOM, "10"),
-      Declaration(constants::css_properties::MARGIN_TOP, "10"),
-  };
-  Rule p({Selector(constants::html_tags::P)}, p_declarations);
-  rules.push_back(p);
+const std::vector<Rule>& getDefaultTagRules() {
+  static const std::vector<Rule> rules = buildDefaultTagRules();
+  return rules;
+}
 
-  std::vector<Declaration> a_declarations = {
-      Declaration(constants::css_properties::TEXT_DECORATION,
-                  constants::css_font_values::UNDERLINE),
-      Declaration(constants::css_properties::COLOR, "#0000EE"),
-  };
-  Rule a({Selector(constants::html_tags::A)}, a_declarations);
-  rules.push_back(a);
+RuleIndex::RuleIndex(const std::vector<Rule>& rules) {
+  for (int i = 0; i < rules.size(); i++) {
+    for (auto const& selector : rules[i].get_selectors()) {
+      const std::string& tag = selector.get_tag();
+      const std::string& id = selector.get_id();
+      const std::vector<std::string>& classes = selector.get_classes();
+      // A selector can match on any one of its components, so the rule is
+      // filed under each of them.
+      if (!id.empty()) {
+        by_id_[id].push_back(i);
+      }
+      for (auto const& c : classes) {
+        by_class_[c].push_back(i);
+      }
+      if (tag == "*" || (tag.empty() && id.empty() && classes.empty())) {
+        universal_.push_back(i);
+      } else if (!tag.empty()) {
+        by_tag_[tag].push_back(i);
+      }
+    }
+  }
+}
 
-  std::vector<Declaration> hr_declarations = {
-      Declaration(constants::css_properties::HEIGHT, "1"),
-      Declaration(constants::css_properties::BACKGROUND_COLOR, "#000000"),
+void RuleIndex::getCandidates(absl::string_view tag, absl::string_view id,
+                              const std::vector<absl::string_view>& classes,
+                              std::vector<int>* candidates) const {
+  candidates->clear();
+  auto addBucket = [candidates](
+                       const std::unordered_map<std::string, std::vector<int>>&
+                           buckets,
+                       absl::string_view key) {
+    auto it = buckets.find(std::string(key));
+    if (it != buckets.end()) {
+      candidates->insert(candidates->end(), it->second.begin(),
+                         it->second.end());
+    }
   };
-  Rule hr({Selector(constants::html_tags::HR)}, hr_declarations);
-  rules.push_back(hr);
-
-  // Font styling tags
-  Rule em({Selector(constants::html_tags::EM)},
-          {Declaration(constants::css_properties::FONT_STYLE,
-                       constants::css_font_values::ITALIC)});
-  rules.push_back(em);
-  Rule b({Selector(constants::html_tags::BOLD)},
-         {Declaration(constants::css_properties::FONT_WEIGHT,
-                      constants::css_font_values::BOLD)});
-  rules.push_back(b);
-  return rules;
+  candidates->insert(candidates->end(), universal_.begin(), universal_.end());
+  addBucket(by_tag_, tag);
+  if (!id.empty()) {
+    addBucket(by_id_, id);
+  }
+  for (auto const& c : classes) {
+    addBucket(by_class_, c);
+  }
+  // A rule can be filed under several buckets. Restore stylesheet order so the
+  // cascade sees rules in the same order as a full scan would.
+  std::sort(candidates->begin(), candidates->end());
+  candidates->erase(std::unique(candidates->begin(), candidates->end()),
+                    candidates->end());
 }
 
-std::vector<Rule> StyleSheet::get_rules() const {
-  std::vector<Rule> all_rules = getDefaultTagRules();
-  // Concatenate the specified rules
-  all_rules.insert(all_rules.end(), rules_.begin(), rules_.end());
-  return all_rules;
-}
+StyleSheet::StyleSheet(const std::vector<Rule>& rules)
+    : rules_(cascadeRules(rules)), index_(rules_) {}
 
-void Declaration::log() {
-  logger::info(absl::StrFormat("declaration: %s=%s", name_, value_));
+void Declaration::log() const {
+  LOG_DEBUG(absl::StrFormat("declaration: %s=%s", name_, value_));
 }
-void Selector::log() {
+void Selector::log() const {
+  if (!logger::isEnabled(logger::Level::Debug)) {
+    return;
+  }
   std::string str = absl::StrFormat("selector: %s, %s", tag_name_, id_);
-  for (auto c : classes_) {
+  for (auto const& c : classes_) {
     str += c + ' ';
   }
-  logger::info(str);
+  logger::debug(str);
 }
 
-Specificity Selector::getSpecificity() {
+Specificity Selector::getSpecificity() const {
   bool hasId = get_id() != "";
   bool hasTag = get_tag() != "";
   Specificity specificity(hasId, get_classes().size(), hasTag);
   return specificity;
 }
 
-CSSParser::CSSParser(int pos, const std::string& input)
+CSSParser::CSSParser(std::size_t pos, absl::string_view input)
     : BaseParser(pos, input){};
 
 std::vector<Rule> CSSParser::parseRules() {
   std::vector<Rule> rules;
+  consumeWhitespace();
   while (!endOfInput()) {
+    // Comments may appear between any two rules.
     if (startsWith("/*")) {
       parseComment();
+      continue;
     }
-    consumeWhitespace();
     rules.push_back(parseRule());
+    consumeWhitespace();
   }
   return rules;
 }
@@ -187,6 +238,7 @@ std::vector<Declaration> CSSParser::parseDeclarations() {
     consumeWhitespace();
     if (startsWith("/*")) {
       parseComment();
+      continue;
     }
     if (nextChar() == '}') {
       consumeChar();
@@ -199,25 +251,28 @@ std::vector<Declaration> CSSParser::parseDeclarations() {
 }
 
 Rule CSSParser::parseRule() {
-  return Rule(parseSelectors(), parseDeclarations());
+  // Selectors must be consumed before declarations, so don't rely on the
+  // (unspecified) evaluation order of constructor arguments.
+  std::vector<Selector> selectors = parseSelectors();
+  return Rule(selectors, parseDeclarations());
 }
 
-std::string CSSParser::parseIdentifier() {
-  return consumeWhile(validSelectorChar);
+absl::string_view CSSParser::parseIdentifier() {
+  return consumeUntilAny(kSelectorStop);
 }
 
-std::string CSSParser::parseProperty() {
-  return consumeWhile(validPropertyChar);
+absl::string_view CSSParser::parseProperty() {
+  return consumeWhileAny(kPropertyChars);
 }
 
-std::string CSSParser::parseValue() { return consumeWhile(validValueChar); }
+absl::string_view CSSParser::parseValue() {
+  return consumeUntilAny(kValueStop);
+}
 
 void CSSParser::parseComment() {
   assert(consumeChar() == '/');
   assert(consumeChar() == '*');
-  while (!startsWith("*/")) {
-    consumeChar();
-  }
+  consumeUntil("*/");
   assert(consumeChar() == '*');
   assert(consumeChar() == '/');
   consumeWhitespace();
@@ -225,11 +280,11 @@ void CSSParser::parseComment() {
 
 Declaration CSSParser::parseDeclaration() {
   consumeWhitespace();
-  std::string name = parseProperty();
+  std::string name(parseProperty());
   consumeWhitespace();
   assert(consumeChar() == ':');
   consumeWhitespace();
-  std::string value = parseValue();
+  std::string value(parseValue());
   consumeWhitespace();
   char closing = nextChar();
   assert(closing == ';' || closing == '}');
@@ -251,14 +306,14 @@ Selector CSSParser::parseSimpleSelector() {
     char nc = nextChar();
     if (nc == '#') {
       consumeChar();
-      id = parseIdentifier();
+      id = std::string(parseIdentifier());
     } else if (nc == '.') {
       consumeChar();
-      classes.push_back(parseIdentifier());
+      classes.emplace_back(parseIdentifier());
     } else if (nc == '*') {
       consumeChar();
-    } else if (validSelectorChar(nc)) {
-      tag_name = parseIdentifier();
+    } else if (!endOfInput() && !kSelectorStop.contains(nc)) {
+      tag_name = std::string(parseIdentifier());
     } else {
       break;
     }
@@ -267,7 +322,8 @@ Selector CSSParser::parseSimpleSelector() {
   return selector;
 }
 
-std::unique_ptr<StyleSheet const> parseCss(const std::string& source) {
+std::unique_ptr<StyleSheet const> parseCss(absl::string_view source) {
+  TRACE_SPAN("parseCss");
   logger::info("****** Parsing CSS ******");
   CSSParser parser(0, source);
   std::vector<Rule> rules = parser.parseRules();
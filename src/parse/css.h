@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 #include "parser.h"
@@ -26,11 +27,11 @@ class Selector {
     id_ = id;
     classes_ = classes;
   }
-  void log();
-  Specificity getSpecificity();
-  std::string get_tag() { return tag_name_; }
-  std::string get_id() { return id_; }
-  std::vector<std::string> get_classes() { return classes_; }
+  void log() const;
+  Specificity getSpecificity() const;
+  const std::string& get_tag() const { return tag_name_; }
+  const std::string& get_id() const { return id_; }
+  const std::vector<std::string>& get_classes() const { return classes_; }
 };
 
 class Declaration {
@@ -42,9 +43,9 @@ class Declaration {
     name_ = name;
     value_ = value;
   }
-  void log();
-  std::string get_name() { return name_; };
-  std::string get_value() { return value_; };
+  void log() const;
+  const std::string& get_name() const { return name_; };
+  const std::string& get_value() const { return value_; };
 };
 
 class Rule {
@@ -52,22 +53,49 @@ class Rule {
   std::vector<Declaration> declarations_;
 
  public:
-  Rule(std::vector<Selector> selectors, std::vector<Declaration> declarations) {
-    selectors_ = selectors;
-    declarations_ = declarations;
-  };
-  std::vector<Declaration> get_declarations() { return declarations_; }
-  std::vector<Selector> get_selectors() { return selectors_; };
+  Rule(std::vector<Selector> selectors, std::vector<Declaration> declarations)
+      : selectors_(std::move(selectors)),
+        declarations_(std::move(declarations)){};
+  const std::vector<Declaration>& get_declarations() const {
+    return declarations_;
+  }
+  const std::vector<Selector>& get_selectors() const { return selectors_; };
+};
+
+// Buckets rules by the id, classes and tag of their selectors, so that
+// matching an element only needs to probe the rules that could apply to it.
+// Rules are referred to by their position in StyleSheet::get_rules().
+class RuleIndex {
+  std::unordered_map<std::string, std::vector<int>> by_id_;
+  std::unordered_map<std::string, std::vector<int>> by_class_;
+  std::unordered_map<std::string, std::vector<int>> by_tag_;
+  std::vector<int> universal_;
+
+ public:
+  RuleIndex(){};
+  RuleIndex(const std::vector<Rule>& rules);
+  // Fills `candidates` with the positions of rules that may match an element
+  // with the given tag, id and classes, in stylesheet order.
+  void getCandidates(absl::string_view tag, absl::string_view id,
+                     const std::vector<absl::string_view>& classes,
+                     std::vector<int>* candidates) const;
 };
 
+// The user-agent rules followed by the author rules, in cascade order. The
+// rule store is built once and never changes after construction.
 class StyleSheet {
-  std::vector<Rule> rules_;
+  const std::vector<Rule> rules_;
+  const RuleIndex index_;
 
  public:
-  StyleSheet(std::vector<Rule> rules) { rules_ = rules; }
-  std::vector<Rule> get_rules() const;
+  StyleSheet(const std::vector<Rule>& rules);
+  const std::vector<Rule>& get_rules() const { return rules_; }
+  const RuleIndex& get_index() const { return index_; }
 };
 
+// Returns the user-agent stylesheet, which is constructed on first use.
+const std::vector<Rule>& getDefaultTagRules();
+
 class CSSParser : public BaseParser {
  private:
   Rule parseRule();
@@ -76,16 +104,18 @@ class CSSParser : public BaseParser {
   Declaration parseDeclaration();
   Selector parseSimpleSelector();
   void parseComment();
-  std::string parseIdentifier();
-  std::string parseProperty();
-  std::string parseValue();
+  absl::string_view parseIdentifier();
+  absl::string_view parseProperty();
+  absl::string_view parseValue();
 
  public:
-  CSSParser(int pos, const std::string& input);
+  CSSParser(std::size_t pos, absl::string_view input);
   std::vector<Rule> parseRules();
 };
 
-std::unique_ptr<StyleSheet const> parseCss(const std::string& source);
+// Entrypoint to CSS parser. The stylesheet copies what it keeps, so `source`
+// need not outlive it.
+std::unique_ptr<StyleSheet const> parseCss(absl::string_view source);
 }  // namespace css
 
 #endif
@@ -8,54 +8,79 @@
 #include "absl/strings/ascii.h"
 
 #include "../constants.h"
+#include "../trace.h"
 #include "../util.h"
 
 namespace html_parser {
 
-std::vector<std::unique_ptr<dom::TextNode>> HtmlParser::parseTextNodes() {
-  std::vector<std::unique_ptr<dom::TextNode>> nodes;
-  // Consume text nodes until the next opening tag
-  while (nextChar() != '<') {
-    std::string word =
-        consumeWhile([](char c) { return !isspace(c) && c != '<'; });
-    std::unique_ptr<dom::TextNode> node(new dom::TextNode(std::move(word)));
-    nodes.push_back(std::move(node));
-    // TODO: only add in space if next character is a space
-    std::unique_ptr<dom::TextNode> space(new dom::TextNode(" "));
-    nodes.push_back(std::move(space));
+namespace {
+// Characters that end a word of text.
+const scan::CharSet kTextStop(" \t\n\v\f\r<");
+// Characters that end a tag or attribute name.
+const scan::CharSet kWordStop(" \t\n\v\f\r=>/");
+const scan::CharSet kDoubleQuote("\"");
+const scan::CharSet kSingleQuote("'");
+
+// Appends `node` to `parent` (if any), remembering the first appended node.
+void appendNode(dom::Node *parent, dom::Node *node, dom::Node **first) {
+  if (parent != nullptr) {
+    parent->appendChild(node);
+  }
+  if (*first == nullptr) {
+    *first = node;
+  }
+}
+}  // namespace
+
+dom::TextNode *HtmlParser::parseTextNode() {
+  const char *start = nullptr;
+  const char *end = nullptr;
+  std::vector<uint32_t> word_breaks;
+  // Consume words until the next opening tag, recording where each one starts
+  // and ends relative to the start of the run.
+  while (!endOfInput() && nextChar() != '<') {
+    absl::string_view word = consumeUntilAny(kTextStop);
+    if (start == nullptr) {
+      start = word.data();
+    }
+    end = word.data() + word.size();
+    word_breaks.push_back(word.data() - start);
+    word_breaks.push_back(end - start);
     consumeWhitespace();
   };
-  return nodes;
+  return arena_->make<dom::TextNode>(absl::string_view(start, end - start),
+                                     std::move(word_breaks));
 }
 
-std::unique_ptr<dom::ElementNode> HtmlParser::parseElementNode() {
+dom::ElementNode *HtmlParser::parseElementNode() {
   // Parse opening tag and attributes.
   assert(consumeChar() == '<');
-  std::string opening_tag = parseWord();
+  absl::string_view opening_tag = parseWord();
   Attrs attrs = parseAttributes();
   consumeWhitespace();
+  if (on_image_ && opening_tag == constants::html_tags::IMG) {
+    auto src = attrs.find(constants::html_attributes::SRC);
+    if (src != attrs.end()) {
+      on_image_(src->second);
+    }
+  }
   // Handle self-closing elements.
   if (startsWith("/>")) {
     assert(consumeChar() == '/');
     assert(consumeChar() == '>');
-    std::vector<std::unique_ptr<dom::Node>> children;
-    std::unique_ptr<dom::ElementNode> node(new dom::ElementNode(
-        std::move(opening_tag), std::move(attrs), std::move(children)));
-    return node;
+    return arena_->make<dom::ElementNode>(opening_tag, std::move(attrs));
   }
   assert(consumeChar() == '>');
 
-  // Parse the element's children recursively.
-  std::vector<std::unique_ptr<dom::Node>> children = parseNodes();
+  dom::ElementNode *node =
+      arena_->make<dom::ElementNode>(opening_tag, std::move(attrs));
   // If the current element is a <li>, insert a bullet element.
   if (opening_tag == constants::html_tags::LI) {
-    std::unique_ptr<dom::ElementNode> bulletNode(
-        new dom::ElementNode(constants::html_tags::BULLET, Attrs(),
-                             std::vector<std::unique_ptr<dom::Node>>()));
-    children.insert(children.begin(), std::move(bulletNode));
+    node->appendChild(
+        arena_->make<dom::ElementNode>(constants::html_tags::BULLET, Attrs()));
   }
-  std::unique_ptr<dom::ElementNode> node(
-      new dom::ElementNode(opening_tag, std::move(attrs), std::move(children)));
+  // Parse the element's children recursively.
+  parseNodes(node);
 
   // Parse the closing tag.
   assert(consumeChar() == '<');
@@ -72,9 +97,7 @@ void HtmlParser::parseComment() {
   assert(consumeChar() == '!');
   assert(consumeChar() == '-');
   assert(consumeChar() == '-');
-  while (!startsWith("-->")) {
-    consumeChar();
-  }
+  consumeUntil("-->");
   assert(consumeChar() == '-');
   assert(consumeChar() == '-');
   assert(consumeChar() == '>');
@@ -86,43 +109,37 @@ Attrs HtmlParser::parseAttributes() {
   // Until we reach a closing, parse attributes
   while (nextChar() != '>' && !startsWith("/>")) {
     consumeWhitespace();
-    std::pair<std::string, std::string> kv = parseAttribute();
+    std::pair<absl::string_view, absl::string_view> kv = parseAttribute();
     attrs[kv.first] = kv.second;
     consumeWhitespace();
   }
   return attrs;
 }
 
-std::pair<const std::string &, const std::string &>
-HtmlParser::parseAttribute() {
-  std::string name = parseWord();
+std::pair<absl::string_view, absl::string_view> HtmlParser::parseAttribute() {
+  absl::string_view name = absl::StripAsciiWhitespace(parseWord());
   assert(consumeChar() == '=');
-  std::string value = parseAttrValue();
-  absl::RemoveExtraAsciiWhitespace(&name);
-  absl::RemoveExtraAsciiWhitespace(&value);
-  std::pair<std::string, std::string> kv(name, value);
-  return kv;
+  absl::string_view value = absl::StripAsciiWhitespace(parseAttrValue());
+  return std::make_pair(name, value);
 }
 
-std::string HtmlParser::parseAttrValue() {
+absl::string_view HtmlParser::parseAttrValue() {
   char open_quote = consumeChar();
   assert(open_quote == '"' || open_quote == '\'');
-  std::string value =
-      consumeWhile([open_quote](char c) { return c != open_quote; });
+  absl::string_view value =
+      consumeUntilAny(open_quote == '"' ? kDoubleQuote : kSingleQuote);
   assert(consumeChar() == open_quote);
   return value;
 }
 
-std::string HtmlParser::parseWord() {
-  std::string tag = consumeWhile([](char c) {
-    return c != ' ' && c != '=' && c != '>' && c != '/';
-  });
+absl::string_view HtmlParser::parseWord() {
+  absl::string_view tag = consumeUntilAny(kWordStop);
   return tag;
 }
 
-std::vector<std::unique_ptr<dom::Node>> HtmlParser::parseNodes() {
+dom::Node *HtmlParser::parseNodes(dom::Node *parent) {
   consumeWhitespace();
-  std::vector<std::unique_ptr<dom::Node>> nodes;
+  dom::Node *first = nullptr;
   // While we haven't reached the end of the document or a closing tag,
   // continue to parse from the current position.
   while (!endOfInput() && !startsWith("</")) {
@@ -130,24 +147,26 @@ std::vector<std::unique_ptr<dom::Node>> HtmlParser::parseNodes() {
     if (startsWith("<!--")) {
       parseComment();
     } else if (nextChar() == '<') {
-      nodes.push_back(parseElementNode());
+      appendNode(parent, parseElementNode(), &first);
     } else {
-      std::vector<std::unique_ptr<dom::TextNode>> next_nodes = parseTextNodes();
-      for (auto &n : next_nodes) {
-        nodes.push_back(std::move(n));
-      }
+      appendNode(parent, parseTextNode(), &first);
     }
     consumeWhitespace();
   }
   consumeWhitespace();
-  return nodes;
+  return first;
 }
 
-std::unique_ptr<dom::Node> parseHtml(const std::string &source) {
+std::unique_ptr<dom::Document> parseHtml(std::unique_ptr<io::MappedFile> source,
+                                         ImageCallback on_image) {
+  TRACE_SPAN("parseHtml");
   logger::info("****** Parsing HTML ******");
-  HtmlParser parser(0, source);
-  // We assume there is only one root node and thus return the first node
+  std::unique_ptr<dom::Document> document(new dom::Document(std::move(source)));
+  HtmlParser parser(0, document->get_source(), document->get_arena(),
+                    on_image);
+  // We assume there is only one root node and thus use the first node
   // in the top-level of the tree.
-  return std::move(parser.parseNodes()[0]);
+  document->set_root(parser.parseNodes(nullptr));
+  return document;
 }
 }  // namespace html_parser
@@ -11,30 +11,44 @@
 
 namespace html_parser {
 
+typedef std::function<void(absl::string_view src)> ImageCallback;
+
 // Parses HTML source string into a tree of DOM nodes.
 class HtmlParser : public BaseParser {
  private:
+  // Arena that parsed nodes are allocated in.
+  arena::Arena *arena_;
+  // Called with the src of each <img> as soon as its tag is parsed.
+  ImageCallback on_image_;
   // Parses an ElementNode from the source string.
-  std::unique_ptr<dom::ElementNode> parseElementNode();
+  dom::ElementNode *parseElementNode();
   // Parses a comment from the HTML source string.
   void parseComment();
-  // Parses one or more TextNodes from the source string.
-  std::vector<std::unique_ptr<dom::TextNode>> parseTextNodes();
+  // Parses a run of text up to the next tag into a single TextNode.
+  dom::TextNode *parseTextNode();
   // Parse attributes of an HTML node (e.g. class from <div class="foo">)
   Attrs parseAttributes();
   // Parse single attribute of an HTML node
-  std::pair<const std::string &, const std::string &> parseAttribute();
+  std::pair<absl::string_view, absl::string_view> parseAttribute();
   // Parse a single word, e.g. "div" or "class"
-  std::string parseWord();
+  absl::string_view parseWord();
   // Parse the value of an HTML node attribute.
-  std::string parseAttrValue();
+  absl::string_view parseAttrValue();
 
  public:
-  HtmlParser(int pos, std::string input) : BaseParser(pos, std::move(input)){};
-  std::vector<std::unique_ptr<dom::Node>> parseNodes();
+  HtmlParser(std::size_t pos, absl::string_view input, arena::Arena *arena,
+             ImageCallback on_image = nullptr)
+      : BaseParser(pos, input), arena_(arena), on_image_(on_image){};
+  // Parses sibling nodes until a closing tag, appending them to `parent` if
+  // one is given. Returns the first node.
+  dom::Node *parseNodes(dom::Node *parent);
 };
 
-// Entrypoint to HTML parser.
-std::unique_ptr<dom::Node> parseHtml(const std::string &source);
+// Entrypoint to HTML parser. The returned document takes ownership of the
+// source, which its DOM nodes refer into. If given, `on_image` is called
+// with the src of each image as it is parsed, so loading can start before
+// parsing finishes.
+std::unique_ptr<dom::Document> parseHtml(std::unique_ptr<io::MappedFile> source,
+                                         ImageCallback on_image = nullptr);
 }  // namespace html_parser
 #endif
@@ -0,0 +1,119 @@
+// Reads the size of an image from its file header, without decoding it.
+
+#include "image_header.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+
+namespace image_header {
+
+namespace {
+
+// Enough for the PNG, GIF and BMP headers, and the start of a JPEG.
+const int kHeaderBytes = 32;
+
+uint32_t readBigEndian(absl::string_view bytes, std::size_t pos, int count) {
+  uint32_t value = 0;
+  for (int i = 0; i < count; i++) {
+    value = (value << 8) | static_cast<unsigned char>(bytes[pos + i]);
+  }
+  return value;
+}
+
+uint32_t readLittleEndian(absl::string_view bytes, std::size_t pos,
+                          int count) {
+  uint32_t value = 0;
+  for (int i = count - 1; i >= 0; i--) {
+    value = (value << 8) | static_cast<unsigned char>(bytes[pos + i]);
+  }
+  return value;
+}
+
+bool isJpeg(absl::string_view header) {
+  return header.size() >= 3 && header.substr(0, 3) == "\xFF\xD8\xFF";
+}
+
+// Walks the segments of the JPEG in `file` until the frame header, which
+// holds the image size, skipping over each segment's contents.
+bool readJpegSize(std::ifstream &file, ImageSize *size) {
+  file.seekg(2);
+  char buffer[9];
+  while (file.read(buffer, 4)) {
+    absl::string_view segment(buffer, 4);
+    if (static_cast<unsigned char>(segment[0]) != 0xFF) {
+      return false;
+    }
+    unsigned char marker = segment[1];
+    if (marker == 0xFF) {
+      // Fill byte before a marker.
+      file.seekg(-3, std::ios::cur);
+      continue;
+    }
+    uint32_t length = readBigEndian(segment, 2, 2);
+    // Start of frame markers, other than DHT (C4), JPG (C8) and DAC (CC).
+    bool is_frame = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 &&
+                    marker != 0xC8 && marker != 0xCC;
+    if (is_frame) {
+      // Precision, then height and width.
+      if (!file.read(buffer, 5)) {
+        return false;
+      }
+      absl::string_view frame(buffer, 5);
+      size->height = readBigEndian(frame, 1, 2);
+      size->width = readBigEndian(frame, 3, 2);
+      return true;
+    }
+    if (marker == 0xDA || length < 2) {
+      // Image data started without a frame header.
+      return false;
+    }
+    file.seekg(length - 2, std::ios::cur);
+  }
+  return false;
+}
+
+}  // namespace
+
+bool parseHeader(absl::string_view header, ImageSize *size) {
+  if (header.size() >= 24 && header.substr(0, 8) == "\x89PNG\r\n\x1A\n" &&
+      header.substr(12, 4) == "IHDR") {
+    size->width = readBigEndian(header, 16, 4);
+    size->height = readBigEndian(header, 20, 4);
+    return true;
+  }
+  if (header.size() >= 10 &&
+      (header.substr(0, 6) == "GIF87a" || header.substr(0, 6) == "GIF89a")) {
+    size->width = readLittleEndian(header, 6, 2);
+    size->height = readLittleEndian(header, 8, 2);
+    return true;
+  }
+  if (header.size() >= 26 && header.substr(0, 2) == "BM") {
+    // BITMAPCOREHEADER has 16-bit dimensions, later headers 32-bit ones.
+    // Bottom-up bitmaps have a negative height.
+    if (readLittleEndian(header, 14, 4) == 12) {
+      size->width = readLittleEndian(header, 18, 2);
+      size->height = readLittleEndian(header, 20, 2);
+    } else {
+      size->width = static_cast<int32_t>(readLittleEndian(header, 18, 4));
+      size->height =
+          std::abs(static_cast<int32_t>(readLittleEndian(header, 22, 4)));
+    }
+    return true;
+  }
+  return false;
+}
+
+bool readImageSize(const std::string &path, ImageSize *size) {
+  std::ifstream file(path, std::ios::binary);
+  char buffer[kHeaderBytes];
+  file.read(buffer, kHeaderBytes);
+  absl::string_view header(buffer, file.gcount());
+  if (isJpeg(header)) {
+    file.clear();
+    return readJpegSize(file, size);
+  }
+  return parseHeader(header, size);
+}
+
+}  // namespace image_header
@@ -0,0 +1,30 @@
+// Reads the size of an image from its file header, without decoding it.
+
+#ifndef IMAGE_HEADER_H
+#define IMAGE_HEADER_H
+
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace image_header {
+
+struct ImageSize {
+  int width = 0;
+  int height = 0;
+};
+
+// Reads the size of a PNG, GIF or BMP image from the start of its file.
+// `header` must hold at least the first 26 bytes. Returns false if the format
+// isn't recognized. JPEG sizes can be further in, so use readImageSize for
+// those.
+bool parseHeader(absl::string_view header, ImageSize *size);
+
+// Reads the size of the PNG, JPEG, GIF or BMP image at `path`. Only reads the
+// file header, and for JPEGs the headers of the segments before the image
+// data. Returns false if the file can't be read or isn't a recognized format.
+bool readImageSize(const std::string &path, ImageSize *size);
+
+}  // namespace image_header
+
+#endif
@@ -5,31 +5,38 @@
 
 #include "parser.h"
 
-char BaseParser::nextChar() { return input_[pos_]; };
+char BaseParser::nextChar() { return endOfInput() ? '\0' : input_[pos_]; };
 
 char BaseParser::lastChar() { return input_[pos_ - 1]; };
 
-bool BaseParser::startsWith(const std::string& str) {
-  std::size_t index = input_.find(str, pos_) - pos_;
-  return index == 0;
+bool BaseParser::startsWith(absl::string_view str) {
+  return scan::startsWith(input_, pos_, str);
 };
 
 bool BaseParser::endOfInput() { return pos_ >= input_.size(); };
 
-std::string BaseParser::consumeWhile(std::function<bool(char)> condition) {
-  int start_pos = pos_;
-  while (condition(nextChar())) {
-    pos_ += 1;
-  }
+absl::string_view BaseParser::consumeUntilAny(const scan::CharSet& stop) {
+  std::size_t start_pos = pos_;
+  pos_ = scan::findFirstOf(input_, pos_, stop);
+  return input_.substr(start_pos, pos_ - start_pos);
+}
+
+absl::string_view BaseParser::consumeWhileAny(const scan::CharSet& chars) {
+  std::size_t start_pos = pos_;
+  pos_ = scan::findFirstNotOf(input_, pos_, chars);
   return input_.substr(start_pos, pos_ - start_pos);
 }
 
+void BaseParser::consumeUntil(absl::string_view str) {
+  pos_ = scan::find(input_, pos_, str);
+}
+
 char BaseParser::consumeChar() {
-  char currChar = input_[pos_];
-  pos_ += 1;
+  char currChar = nextChar();
+  if (!endOfInput()) {
+    pos_ += 1;
+  }
   return currChar;
 }
 
-void BaseParser::consumeWhitespace() {
-  consumeWhile([](char c) { return isspace(c); });
-}
+void BaseParser::consumeWhitespace() { consumeWhileAny(scan::kWhitespace); }
@@ -3,24 +3,29 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <functional>
 #include <iostream>
 
-// A base parser used for HTML and CSS parsing.
+#include "absl/strings/string_view.h"
+
+#include "scan.h"
+
+// A base parser used for HTML and CSS parsing. The parser does not own its
+// input; tokens it returns are views into the input buffer.
 class BaseParser {
  private:
-  int pos_;
-  std::string input_;
+  std::size_t pos_;
+  absl::string_view input_;
 
  protected:
-  // Reads the next character without consuming it.
+  // Reads the next character without consuming it. Returns '\0' at the end
+  // of the input.
   char nextChar();
 
   // Reads the last (previous) character
   char lastChar();
 
   // Returns true if the next characters start with the provided string
-  bool startsWith(const std::string& str);
+  bool startsWith(absl::string_view str);
 
   // Return true if all input has been consumed.
   bool endOfInput();
@@ -31,12 +36,21 @@ class BaseParser {
   // Consumes until the next non-whitespace character
   void consumeWhitespace();
 
-  // Consumes characters until `condition` function returns false.
-  std::string consumeWhile(std::function<bool(char)> condition);
+  // Consumes characters up to the next one in `stop` (or the end of input),
+  // and returns a view of the consumed characters.
+  absl::string_view consumeUntilAny(const scan::CharSet& stop);
+
+  // Consumes characters while they are in `chars`, and returns a view of the
+  // consumed characters.
+  absl::string_view consumeWhileAny(const scan::CharSet& chars);
+
+  // Consumes characters up to the next occurrence of `str` (or the end of
+  // input). `str` itself is not consumed.
+  void consumeUntil(absl::string_view str);
 
  public:
-  BaseParser(int pos, std::string input)
-      : pos_(pos), input_(std::move(input)){};
+  BaseParser(std::size_t pos, absl::string_view input)
+      : pos_(pos), input_(input){};
 };
 
 #endif
@@ -0,0 +1,201 @@
+// Vectorized scanning primitives shared by the HTML and CSS parsers.
+
+#include "scan.h"
+
+#include <cstring>
+
+#include "../simd.h"
+
+// AVX2 kernels are compiled with a target attribute and only called after
+// checking the CPU at runtime, so the build needs no extra flags.
+#ifdef SIMD_SSE2
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+namespace {
+
+// Returns the first position at or after `pos` whose membership in `set`
+// equals `in_set`, or `size` if there is none.
+typedef std::size_t (*ScanFn)(const char *data, std::size_t size,
+                              std::size_t pos, const CharSet &set,
+                              bool in_set);
+
+std::size_t scanScalar(const char *data, std::size_t size, std::size_t pos,
+                       const CharSet &set, bool in_set) {
+  while (pos < size && set.contains(data[pos]) != in_set) {
+    pos++;
+  }
+  return pos;
+}
+
+#ifdef SIMD_SSE2
+std::size_t scanSse2(const char *data, std::size_t size, std::size_t pos,
+                     const CharSet &set, bool in_set) {
+  const std::string &chars = set.get_chars();
+  if (chars.size() > CharSet::kMaxVectorChars) {
+    return scanScalar(data, size, pos, set, in_set);
+  }
+  __m128i needles[CharSet::kMaxVectorChars];
+  for (std::size_t i = 0; i < chars.size(); i++) {
+    needles[i] = _mm_set1_epi8(chars[i]);
+  }
+  // Never load past the end of the input, which may be the end of a mapping.
+  while (pos + 16 <= size) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+    __m128i hits = _mm_setzero_si128();
+    for (std::size_t i = 0; i < chars.size(); i++) {
+      hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[i]));
+    }
+    unsigned mask = _mm_movemask_epi8(hits);
+    if (!in_set) {
+      mask = ~mask & 0xffff;
+    }
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 16;
+  }
+  return scanScalar(data, size, pos, set, in_set);
+}
+
+__attribute__((target("avx2"))) std::size_t scanAvx2(const char *data,
+                                                     std::size_t size,
+                                                     std::size_t pos,
+                                                     const CharSet &set,
+                                                     bool in_set) {
+  const std::string &chars = set.get_chars();
+  if (chars.size() > CharSet::kMaxVectorChars) {
+    return scanScalar(data, size, pos, set, in_set);
+  }
+  __m256i needles[CharSet::kMaxVectorChars];
+  for (std::size_t i = 0; i < chars.size(); i++) {
+    needles[i] = _mm256_set1_epi8(chars[i]);
+  }
+  while (pos + 32 <= size) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + pos));
+    __m256i hits = _mm256_setzero_si256();
+    for (std::size_t i = 0; i < chars.size(); i++) {
+      hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[i]));
+    }
+    unsigned mask = _mm256_movemask_epi8(hits);
+    if (!in_set) {
+      mask = ~mask;
+    }
+    if (mask != 0) {
+      return pos + __builtin_ctz(mask);
+    }
+    pos += 32;
+  }
+  // Finish the last partial vector with the narrower kernel.
+  return scanSse2(data, size, pos, set, in_set);
+}
+#endif
+
+struct Implementation {
+  ScanFn scan;
+  const char *name;
+};
+
+// Every implementation, fastest first.
+const Implementation kImplementations[] = {
+#ifdef SIMD_SSE2
+    {scanAvx2, "avx2"},
+    {scanSse2, "sse2"},
+#endif
+    {scanScalar, "scalar"},
+};
+
+bool isSupported(const Implementation &implementation) {
+#ifdef SIMD_SSE2
+  if (implementation.scan == scanAvx2) {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+  }
+#endif
+  return true;
+}
+
+Implementation selectImplementation() {
+  for (const Implementation &implementation : kImplementations) {
+    if (isSupported(implementation)) {
+      return implementation;
+    }
+  }
+  return kImplementations[0];
+}
+
+// The CPU is checked once, the first time anything is scanned.
+Implementation &getImplementation() {
+  static Implementation implementation = selectImplementation();
+  return implementation;
+}
+
+}  // namespace
+
+const CharSet kWhitespace(" \t\n\v\f\r");
+
+CharSet::CharSet(absl::string_view chars) {
+  for (char c : chars) {
+    if (!contains(c)) {
+      table_[static_cast<unsigned char>(c)] = true;
+      chars_.push_back(c);
+    }
+  }
+}
+
+std::size_t findFirstOf(absl::string_view s, std::size_t pos,
+                        const CharSet &set) {
+  if (pos >= s.size()) {
+    return s.size();
+  }
+  return getImplementation().scan(s.data(), s.size(), pos, set, true);
+}
+
+std::size_t findFirstNotOf(absl::string_view s, std::size_t pos,
+                           const CharSet &set) {
+  if (pos >= s.size()) {
+    return s.size();
+  }
+  return getImplementation().scan(s.data(), s.size(), pos, set, false);
+}
+
+std::size_t find(absl::string_view s, std::size_t pos,
+                 absl::string_view needle) {
+  if (needle.empty()) {
+    return pos < s.size() ? pos : s.size();
+  }
+  // Jump between occurrences of the needle's first character, and only
+  // compare the rest of the needle there.
+  const CharSet first(needle.substr(0, 1));
+  for (pos = findFirstOf(s, pos, first); pos < s.size();
+       pos = findFirstOf(s, pos + 1, first)) {
+    if (startsWith(s, pos, needle)) {
+      return pos;
+    }
+  }
+  return s.size();
+}
+
+bool startsWith(absl::string_view s, std::size_t pos,
+                absl::string_view prefix) {
+  return pos <= s.size() && s.size() - pos >= prefix.size() &&
+         std::memcmp(s.data() + pos, prefix.data(), prefix.size()) == 0;
+}
+
+const char *getImplementationName() { return getImplementation().name; }
+
+bool setImplementation(absl::string_view name) {
+  for (const Implementation &implementation : kImplementations) {
+    if (name == implementation.name && isSupported(implementation)) {
+      getImplementation() = implementation;
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace scan
@@ -0,0 +1,64 @@
+// Vectorized scanning primitives shared by the HTML and CSS parsers.
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace scan {
+
+// A set of bytes to scan for. Small sets are matched a whole vector at a time,
+// by comparing against each member; larger sets fall back to a table lookup
+// per byte.
+class CharSet {
+  std::string chars_;
+  bool table_[256] = {};
+
+ public:
+  // Sets with at most this many members are scanned with vector compares.
+  static constexpr std::size_t kMaxVectorChars = 16;
+
+  explicit CharSet(absl::string_view chars);
+
+  bool contains(char c) const {
+    return table_[static_cast<unsigned char>(c)];
+  }
+  const std::string &get_chars() const { return chars_; }
+};
+
+// The characters isspace() accepts in the C locale.
+extern const CharSet kWhitespace;
+
+// Returns the position of the first character of `s` at or after `pos` that is
+// in `set`, or s.size() if there is none.
+std::size_t findFirstOf(absl::string_view s, std::size_t pos,
+                        const CharSet &set);
+
+// Returns the position of the first character of `s` at or after `pos` that is
+// not in `set`, or s.size() if there is none.
+std::size_t findFirstNotOf(absl::string_view s, std::size_t pos,
+                           const CharSet &set);
+
+// Returns the position of the next occurrence of `needle` in `s` at or after
+// `pos`, or s.size() if there is none.
+std::size_t find(absl::string_view s, std::size_t pos,
+                 absl::string_view needle);
+
+// Returns true if `s` contains `prefix` at `pos`. Only compares as many
+// characters as `prefix` has.
+bool startsWith(absl::string_view s, std::size_t pos, absl::string_view prefix);
+
+// Name of the implementation picked for this CPU: "avx2", "sse2" or "scalar".
+const char *getImplementationName();
+
+// Switches to the named implementation, so tests can check each one. Returns
+// false if it isn't built in or this CPU can't run it. Not safe to call while
+// other threads are scanning.
+bool setImplementation(absl::string_view name);
+
+}  // namespace scan
+
+#endif
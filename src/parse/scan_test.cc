@@ -0,0 +1,121 @@
+// Checks every scanning implementation against std::string's searches.
+
+#include "scan.h"
+
+#include <memory>
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace scan {
+namespace {
+
+// Bytes the random inputs are drawn from. Few enough that sets get hits,
+// and including bytes above 0x7f, which compare as negative when signed.
+const char kAlphabet[] = "ab c\t\n<>=\"'/-\x80\xff";
+
+// Sets of each size the kernels handle differently: one character, a few,
+// the most that are compared a vector at a time, and one more than that,
+// which falls back to the table.
+const char *const kSets[] = {
+    "<", "<>&", " \t\n\v\f\r", "abcdefghijklmnop", "abcdefghijklmnopq",
+    "\x80\xff",
+};
+
+std::size_t toSize(std::size_t pos, const std::string &s) {
+  return pos == std::string::npos ? s.size() : pos;
+}
+
+class ScanTest : public ::testing::TestWithParam<const char *> {
+ protected:
+  void SetUp() override {
+    if (!setImplementation(GetParam())) {
+      GTEST_SKIP() << GetParam() << " isn't supported here";
+    }
+  }
+  // Later tests expect the implementation picked for this CPU.
+  void TearDown() override { setImplementation(default_implementation_); }
+
+  std::string randomString(std::size_t size) {
+    std::uniform_int_distribution<int> pick(0, sizeof(kAlphabet) - 2);
+    std::string s;
+    for (std::size_t i = 0; i < size; i++) {
+      s += kAlphabet[pick(rng_)];
+    }
+    return s;
+  }
+
+  const std::string default_implementation_ = getImplementationName();
+  std::mt19937 rng_{12345};
+};
+
+TEST_P(ScanTest, SelectsImplementation) {
+  EXPECT_STREQ(getImplementationName(), GetParam());
+}
+
+TEST_P(ScanTest, FindFirstOfMatchesString) {
+  for (const char *chars : kSets) {
+    const CharSet set(chars);
+    // Lengths up to a few vectors, so every tail shorter than a vector is
+    // covered.
+    for (std::size_t size = 0; size <= 100; size++) {
+      std::string s = randomString(size);
+      // Scan a copy of exactly the string's size, so that sanitizers catch
+      // reads past the end.
+      std::unique_ptr<char[]> buffer(new char[size]);
+      std::copy(s.begin(), s.end(), buffer.get());
+      absl::string_view view(buffer.get(), size);
+      for (std::size_t pos = 0; pos <= size + 1; pos++) {
+        EXPECT_EQ(findFirstOf(view, pos, set),
+                  std::min(size, toSize(s.find_first_of(chars, pos), s)))
+            << "set \"" << chars << "\" in \"" << s << "\" from " << pos;
+        EXPECT_EQ(findFirstNotOf(view, pos, set),
+                  std::min(size, toSize(s.find_first_not_of(chars, pos), s)))
+            << "set \"" << chars << "\" in \"" << s << "\" from " << pos;
+      }
+    }
+  }
+}
+
+TEST_P(ScanTest, LongRunsWithoutMatches) {
+  // Runs long enough that several whole vectors are skipped before the
+  // first match.
+  const CharSet set("<&");
+  for (std::size_t size = 1; size <= 300; size += 7) {
+    std::string s(size, 'x');
+    s[size - 1] = '<';
+    EXPECT_EQ(findFirstOf(s, 0, set), size - 1);
+    EXPECT_EQ(findFirstNotOf(s, 0, CharSet("x")), size - 1);
+    s[size - 1] = 'x';
+    EXPECT_EQ(findFirstOf(s, 0, set), size);
+    EXPECT_EQ(findFirstNotOf(s, 0, CharSet("x")), size);
+  }
+}
+
+TEST_P(ScanTest, FindMatchesString) {
+  const char *const needles[] = {"", "<", "-->", "</", "ab c", "\xff\x80"};
+  for (std::size_t size = 0; size <= 100; size++) {
+    std::string s = randomString(size);
+    for (const char *needle : needles) {
+      for (std::size_t pos = 0; pos <= size; pos++) {
+        EXPECT_EQ(find(s, pos, needle), toSize(s.find(needle, pos), s))
+            << "\"" << needle << "\" in \"" << s << "\" from " << pos;
+      }
+    }
+  }
+}
+
+TEST(StartsWithTest, ComparesOnlyWithinString) {
+  EXPECT_TRUE(startsWith("<!-- x -->", 0, "<!--"));
+  EXPECT_TRUE(startsWith("a-->", 1, "-->"));
+  EXPECT_FALSE(startsWith("a--", 1, "-->"));
+  EXPECT_FALSE(startsWith("abc", 4, ""));
+  EXPECT_TRUE(startsWith("abc", 3, ""));
+}
+
+INSTANTIATE_TEST_SUITE_P(AllImplementations, ScanTest,
+                         ::testing::Values("scalar", "sse2", "avx2"));
+
+}  // namespace
+}  // namespace scan
@@ -0,0 +1,79 @@
+// Decodes images on a pool of worker threads.
+
+#include "decoder.h"
+
+#include "../trace.h"
+
+namespace image_render {
+
+ImageDecoder::ImageDecoder(int threads) {
+  for (int i = 0; i < threads; i++) {
+    workers_.emplace_back(&ImageDecoder::work, this);
+  }
+}
+
+ImageDecoder::~ImageDecoder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    queue_.clear();
+  }
+  queued_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ImageDecoder::submit(const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(path);
+    outstanding_++;
+  }
+  queued_.notify_one();
+}
+
+int ImageDecoder::takeResults(std::vector<Result>* results) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int taken = results_.size();
+  for (Result& result : results_) {
+    results->push_back(std::move(result));
+  }
+  results_.clear();
+  return taken;
+}
+
+void ImageDecoder::waitForAll() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  finished_.wait(lock, [this] { return outstanding_ == 0; });
+}
+
+void ImageDecoder::work() {
+  trace::setThreadName("image decoder");
+  while (true) {
+    Result result;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queued_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      result.path = std::move(queue_.front());
+      queue_.pop_front();
+    }
+    // Decode without holding the lock, so other workers can run.
+    TRACE_SPAN("decodeImage");
+    std::unique_ptr<sf::Image> image(new sf::Image);
+    if (image->loadFromFile(result.path)) {
+      result.image = std::move(image);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      results_.push_back(std::move(result));
+      outstanding_--;
+    }
+    finished_.notify_all();
+  }
+}
+
+}  // namespace image_render
@@ -0,0 +1,60 @@
+// Decodes images on a pool of worker threads.
+
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+namespace image_render {
+
+// Decodes image files into sf::Images in the background. Only the decoded
+// pixels are produced here; textures must be created on the thread that owns
+// the window.
+class ImageDecoder {
+ public:
+  struct Result {
+    std::string path;
+    // Null if the image couldn't be loaded.
+    std::unique_ptr<sf::Image> image;
+  };
+
+  explicit ImageDecoder(int threads);
+  // Waits for the decode in progress on each worker, dropping any that
+  // haven't started.
+  ~ImageDecoder();
+
+  // Queues `path` to be decoded.
+  void submit(const std::string& path);
+  // Moves every finished decode into `results`, without blocking. Returns
+  // the number moved.
+  int takeResults(std::vector<Result>* results);
+  // Blocks until every submitted image has been decoded.
+  void waitForAll();
+
+ private:
+  void work();
+
+  std::mutex mutex_;
+  // Signalled when a path is queued or the decoder is shutting down.
+  std::condition_variable queued_;
+  // Signalled when a decode finishes.
+  std::condition_variable finished_;
+  std::deque<std::string> queue_;
+  std::vector<Result> results_;
+  // Images queued or being decoded.
+  int outstanding_ = 0;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace image_render
+
+#endif
@@ -0,0 +1,89 @@
+#include "font_metrics.h"
+
+#include <algorithm>
+
+#include "../simd.h"
+#include "glyph_atlas.h"
+
+namespace text_render {
+
+namespace {
+
+bool isPrintable(char c) { return c >= 0x20 && c < 0x7f; }
+
+}  // namespace
+
+FontMetrics::FontMetrics(int face, unsigned size, bool bold, bool italic) {
+  raster::GlyphAtlas* atlas = raster::GlyphAtlas::getInstance();
+  float shear = italic ? ITALIC_SHEAR : 0;
+  for (int i = 0; i < kCount; i++) {
+    const raster::Glyph& glyph = atlas->getGlyph(face, size, bold, kFirst + i);
+    advances_[i] = glyph.advance;
+    if (kFirst + i == ' ') {
+      // sf::Text counts a space as ink up to the pen position after it.
+      ink_right_[i] = glyph.advance;
+      overhang_[i] = 0;
+    } else {
+      ink_right_[i] = glyph.bounds_left + glyph.bounds_width;
+      overhang_[i] = shear * glyph.bounds_top;
+    }
+  }
+  kerning_.resize(kCount * kCount);
+  bool kerned = false;
+  for (int first = 0; first < kCount; first++) {
+    for (int second = 0; second < kCount; second++) {
+      float kerning =
+          atlas->getKerning(face, size, kFirst + first, kFirst + second);
+      kerning_[first * kCount + second] = kerning;
+      kerned = kerned || kerning != 0;
+    }
+  }
+  if (!kerned) {
+    kerning_.clear();
+  }
+}
+
+bool FontMetrics::isMeasurable(absl::string_view text) {
+  const char* data = text.data();
+  std::size_t i = 0;
+#ifdef SIMD_SSE2
+  // Bytes compare as signed, so anything outside ASCII is below the space.
+  const __m128i below = _mm_set1_epi8(kFirst - 1);
+  const __m128i above = _mm_set1_epi8(kFirst + kCount);
+  for (; i + 16 <= text.size(); i += 16) {
+    __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, below),
+                                      _mm_cmplt_epi8(bytes, above));
+    if (_mm_movemask_epi8(printable) != 0xffff) {
+      return false;
+    }
+  }
+#endif
+  for (; i < text.size(); i++) {
+    if (!isPrintable(data[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+float FontMetrics::measure(absl::string_view text) const {
+  // Same arithmetic, in the same order, as sf::Text's bounds, so results
+  // round the same way.
+  float x = 0;
+  float right = 0;
+  int previous = -1;
+  for (char c : text) {
+    int i = c - kFirst;
+    if (previous >= 0 && !kerning_.empty()) {
+      x += kerning_[previous * kCount + i];
+    }
+    previous = i;
+    right = std::max(right, x + ink_right_[i] - overhang_[i]);
+    x += advances_[i];
+  }
+  return right;
+}
+
+}  // namespace text_render
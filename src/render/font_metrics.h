@@ -0,0 +1,47 @@
+// Glyph metrics for measuring text without building sf::Text objects.
+
+#ifndef FONT_METRICS_H
+#define FONT_METRICS_H
+
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace text_render {
+
+// The slant SFML 2.4's sf::Text gives italic glyphs, about 12 degrees. SFML
+// 2.5 changed it to 0.209.
+const float ITALIC_SHEAR = 0.208;
+
+// Advance, ink extent and kerning tables for printable ASCII in one font,
+// size and style, taken from the same glyphs the software rasterizer draws.
+// Strings are measured by summing advances instead of laying out sf::Text.
+class FontMetrics {
+ public:
+  // The printable ASCII range the tables cover.
+  static const int kFirst = 0x20;
+  static const int kCount = 0x7f - kFirst;
+
+ private:
+  float advances_[kCount];
+  // Right edge of each glyph's ink from its origin, and the italic shear
+  // term sf::Text subtracts from it.
+  float ink_right_[kCount];
+  float overhang_[kCount];
+  // kCount * kCount kerning adjustments, or empty if no pair is kerned.
+  std::vector<float> kerning_;
+
+ public:
+  // `face` is a raster::GlyphAtlas face.
+  FontMetrics(int face, unsigned size, bool bold, bool italic);
+
+  // Whether every byte of `text` is printable ASCII, so it can be measured.
+  static bool isMeasurable(absl::string_view text);
+  // Returns the right edge of the ink of `text`, measured the way
+  // sf::Text::getGlobalBounds() does. `text` must be measurable.
+  float measure(absl::string_view text) const;
+};
+
+}  // namespace text_render
+
+#endif
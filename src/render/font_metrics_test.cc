@@ -0,0 +1,59 @@
+// Checks that FontMetrics measures text the way sf::Text's bounds do.
+
+#include "font_metrics.h"
+
+#include <string>
+
+#include "SFML/Graphics.hpp"
+#include "gtest/gtest.h"
+
+#include "glyph_atlas.h"
+
+namespace text_render {
+namespace {
+
+const char* const kFonts[] = {"fonts/Arial.ttf", "fonts/Roboto.ttf"};
+
+// Words whose last glyph's ink ends before, at and past its advance, with
+// kerned pairs, spaces at either end and every printable character.
+const char* const kWords[] = {
+    "Hello", "world", "AVAVA", "To Ty", "f", "fj", "ff.", " x ", "W",
+    "jump.", "(1)", "[x]", "Ab{c}", "100%", "", " ",
+    " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~",
+};
+
+const unsigned kSizes[] = {10, 12, 14, 16, 23, 32};
+
+class FontMetricsTest : public ::testing::TestWithParam<const char*> {};
+
+TEST_P(FontMetricsTest, MeasureMatchesTextBounds) {
+  sf::Font font;
+  ASSERT_TRUE(font.loadFromFile(GetParam()));
+  int face = raster::GlyphAtlas::getInstance()->loadFace(GetParam());
+  ASSERT_GE(face, 0);
+  for (unsigned size : kSizes) {
+    for (int style = 0; style < 4; style++) {
+      bool bold = style & 1;
+      bool italic = style & 2;
+      FontMetrics metrics(face, size, bold, italic);
+      sf::Text text;
+      text.setFont(font);
+      text.setCharacterSize(size);
+      text.setStyle((bold ? sf::Text::Bold : 0) |
+                    (italic ? sf::Text::Italic : 0));
+      for (const char* word : kWords) {
+        text.setString(word);
+        sf::FloatRect bounds = text.getGlobalBounds();
+        EXPECT_NEAR(metrics.measure(word), bounds.left + bounds.width, 1e-3)
+            << "\"" << word << "\" at " << size << "px, bold " << bold
+            << ", italic " << italic;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Fonts, FontMetricsTest, ::testing::ValuesIn(kFonts));
+
+}  // namespace
+}  // namespace text_render
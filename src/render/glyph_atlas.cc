@@ -0,0 +1,206 @@
+#include "glyph_atlas.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include FT_OUTLINE_H
+
+#include "../util.h"
+
+namespace raster {
+
+namespace {
+
+uint64_t glyphKey(int face, unsigned size, bool bold, uint32_t code_point) {
+  return (uint64_t(face) << 48) | (uint64_t(size & 0xffff) << 32) |
+         (uint64_t(bold) << 31) | code_point;
+}
+
+}  // namespace
+
+GlyphAtlas::GlyphAtlas() {
+  if (FT_Init_FreeType(&library_) != 0) {
+    logger::error("Unable to initialize FreeType");
+    library_ = nullptr;
+  }
+}
+
+GlyphAtlas* GlyphAtlas::getInstance() {
+  // Created once, even if several threads ask for it first at once.
+  static GlyphAtlas* instance = new GlyphAtlas;
+  return instance;
+}
+
+int GlyphAtlas::loadFace(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = face_ids_.find(path);
+  if (it != face_ids_.end()) {
+    return it->second;
+  }
+  FT_Face face;
+  int id = -1;
+  if (library_ != nullptr &&
+      FT_New_Face(library_, path.c_str(), 0, &face) == 0) {
+    id = faces_.size();
+    faces_.push_back(face);
+    face_sizes_.push_back(0);
+  } else {
+    logger::error("Unable to load font for software rendering: " + path);
+  }
+  // A font that can't be loaded is only tried once.
+  face_ids_[path] = id;
+  return id;
+}
+
+bool GlyphAtlas::setSize(int face, unsigned size) {
+  if (face_sizes_[face] == size) {
+    return true;
+  }
+  if (FT_Set_Pixel_Sizes(faces_[face], 0, size) != 0) {
+    return false;
+  }
+  face_sizes_[face] = size;
+  return true;
+}
+
+const Glyph& GlyphAtlas::getGlyph(int face, unsigned size, bool bold,
+                                  uint32_t code_point) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  uint64_t key = glyphKey(face, size, bold, code_point);
+  auto it = glyphs_.find(key);
+  if (it == glyphs_.end()) {
+    it = glyphs_.emplace(key, rasterize(face, size, bold, code_point)).first;
+  }
+  return it->second;
+}
+
+Glyph GlyphAtlas::rasterize(int face_id, unsigned size, bool bold,
+                            uint32_t code_point) {
+  Glyph glyph;
+  FT_Face face = faces_[face_id];
+  // Hinted the way SFML loads glyphs.
+  if (!setSize(face_id, size) ||
+      FT_Load_Char(face, code_point,
+                   FT_LOAD_TARGET_NORMAL | FT_LOAD_FORCE_AUTOHINT) != 0) {
+    return glyph;
+  }
+  // SFML thickens bold glyphs by a pixel and advances one pixel further.
+  const FT_Pos weight = 1 << 6;
+  // Copied before the outline is thickened and rendered.
+  const FT_Glyph_Metrics metrics = face->glyph->metrics;
+  glyph.advance = metrics.horiAdvance / 64.f;
+  if (bold) {
+    if (face->glyph->format == FT_GLYPH_FORMAT_OUTLINE) {
+      FT_Outline_Embolden(&face->glyph->outline, weight);
+    }
+    glyph.advance += weight / 64.f;
+  }
+  if (FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL) != 0) {
+    return glyph;
+  }
+  const FT_Bitmap& bitmap = face->glyph->bitmap;
+  if (bitmap.width > static_cast<unsigned>(kWidth)) {
+    return glyph;
+  }
+  glyph.left = face->glyph->bitmap_left;
+  glyph.top = -face->glyph->bitmap_top;
+  glyph.width = bitmap.width;
+  glyph.height = bitmap.rows;
+  if (glyph.width > 0 && glyph.height > 0) {
+    glyph.bounds_left = metrics.horiBearingX / 64.f;
+    glyph.bounds_top = -metrics.horiBearingY / 64.f;
+    glyph.bounds_width = metrics.width / 64.f;
+  }
+  // Start a new row when this one is full, and a new page when the glyph
+  // doesn't fit below the last row.
+  if (row_x_ + glyph.width > kWidth) {
+    row_y_ += row_height_;
+    row_x_ = 0;
+    row_height_ = 0;
+  }
+  if (pages_.empty() || row_y_ + glyph.height > page_height_) {
+    page_height_ = std::max(glyph.height, int(kPageHeight));
+    std::size_t page_bytes = std::size_t(kWidth) * page_height_;
+    pages_.emplace_back(new uint8_t[page_bytes]());
+    bytes_ += page_bytes;
+    row_x_ = 0;
+    row_y_ = 0;
+    row_height_ = 0;
+  }
+  uint8_t* pixels =
+      pages_.back().get() + std::size_t(row_y_) * kWidth + row_x_;
+  glyph.pixels = pixels;
+  row_x_ += glyph.width;
+  row_height_ = std::max(row_height_, glyph.height);
+  for (int row = 0; row < glyph.height; row++) {
+    std::memcpy(pixels + std::size_t(row) * kWidth,
+                bitmap.buffer + row * bitmap.pitch, glyph.width);
+  }
+  return glyph;
+}
+
+float GlyphAtlas::getKerning(int face, unsigned size, uint32_t first,
+                             uint32_t second) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FT_Face ft_face = faces_[face];
+  if (first == 0 || second == 0 || !FT_HAS_KERNING(ft_face) ||
+      !setSize(face, size)) {
+    return 0;
+  }
+  FT_Vector kerning;
+  FT_Get_Kerning(ft_face, FT_Get_Char_Index(ft_face, first),
+                 FT_Get_Char_Index(ft_face, second), FT_KERNING_DEFAULT,
+                 &kerning);
+  return FT_IS_SCALABLE(ft_face) ? kerning.x / 64.f : kerning.x;
+}
+
+float GlyphAtlas::getUnderlinePosition(int face, unsigned size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FT_Face ft_face = faces_[face];
+  if (!FT_IS_SCALABLE(ft_face) || !setSize(face, size)) {
+    return size / 10.f;
+  }
+  return -FT_MulFix(ft_face->underline_position,
+                    ft_face->size->metrics.y_scale) /
+         64.f;
+}
+
+float GlyphAtlas::getUnderlineThickness(int face, unsigned size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  FT_Face ft_face = faces_[face];
+  if (!FT_IS_SCALABLE(ft_face) || !setSize(face, size)) {
+    return size / 14.f;
+  }
+  return FT_MulFix(ft_face->underline_thickness,
+                   ft_face->size->metrics.y_scale) /
+         64.f;
+}
+
+std::size_t GlyphAtlas::get_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return glyphs_.size();
+}
+
+std::size_t GlyphAtlas::get_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return bytes_;
+}
+
+void GlyphAtlas::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (FT_Face face : faces_) {
+    FT_Done_Face(face);
+  }
+  faces_.clear();
+  face_ids_.clear();
+  face_sizes_.clear();
+  glyphs_.clear();
+  pages_.clear();
+  bytes_ = 0;
+  page_height_ = 0;
+  row_x_ = 0;
+  row_y_ = 0;
+  row_height_ = 0;
+}
+
+}  // namespace raster
@@ -0,0 +1,95 @@
+// Glyph bitmaps for the software rasterizer.
+
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace raster {
+
+// Where a rasterized glyph is in the atlas, and how to place it.
+struct Glyph {
+  // Top left of the glyph's coverage bitmap. Rows are GlyphAtlas::kWidth
+  // bytes apart.
+  const uint8_t* pixels = nullptr;
+  int width = 0;
+  int height = 0;
+  // Offset of the bitmap's top left from the pen position on the baseline.
+  int left = 0;
+  int top = 0;
+  float advance = 0;
+  // The glyph's outline bounds from its FreeType metrics, relative to the
+  // pen position and before bold thickening. sf::Glyph::bounds are these
+  // rather than the bitmap's, so text is measured with them. Zero for glyphs
+  // without ink, as in SFML.
+  float bounds_left = 0;
+  float bounds_top = 0;
+  float bounds_width = 0;
+};
+
+// Process-wide cache of glyph coverage bitmaps, rasterized with FreeType the
+// way SFML rasterizes them for its font textures, so software and SFML text
+// line up. Glyphs are packed into rows of 8-bit pages as they are first
+// drawn. Every method may be called from any thread.
+class GlyphAtlas {
+  // Guards everything below. FreeType faces aren't thread-safe.
+  mutable std::mutex mutex_;
+  FT_Library library_ = nullptr;
+  std::vector<FT_Face> faces_;
+  std::unordered_map<std::string, int> face_ids_;
+  // The size each face was last set to.
+  std::vector<unsigned> face_sizes_;
+  // Keyed by face, size, weight and code point.
+  std::unordered_map<uint64_t, Glyph> glyphs_;
+  // Pages are never moved or resized, so a glyph's pixels stay where they
+  // are while other threads add glyphs.
+  std::vector<std::unique_ptr<uint8_t[]>> pages_;
+  std::size_t bytes_ = 0;
+  int page_height_ = 0;
+  // The row of the last page glyphs are being added to.
+  int row_x_ = 0;
+  int row_y_ = 0;
+  int row_height_ = 0;
+  GlyphAtlas();
+
+  GlyphAtlas(const GlyphAtlas&) = delete;
+  GlyphAtlas& operator=(const GlyphAtlas&) = delete;
+
+  bool setSize(int face, unsigned size);
+  Glyph rasterize(int face, unsigned size, bool bold, uint32_t code_point);
+
+ public:
+  static const int kWidth = 1024;
+  // Pages are this many rows, or as tall as a glyph that needs more.
+  static const int kPageHeight = 256;
+
+  static GlyphAtlas* getInstance();
+  // Returns the id of the face in a font file, loading it the first time, or
+  // -1 if it can't be loaded.
+  int loadFace(const std::string& path);
+  // Returns a glyph, rasterizing it the first time it is needed. The
+  // reference and the glyph's pixels stay valid until clear().
+  const Glyph& getGlyph(int face, unsigned size, bool bold,
+                        uint32_t code_point);
+  float getKerning(int face, unsigned size, uint32_t first, uint32_t second);
+  // Distance of the underline's center below the baseline, and its
+  // thickness.
+  float getUnderlinePosition(int face, unsigned size);
+  float getUnderlineThickness(int face, unsigned size);
+  std::size_t get_count() const;
+  std::size_t get_bytes() const;
+  // Frees every face and glyph.
+  void clear();
+};
+
+}  // namespace raster
+
+#endif
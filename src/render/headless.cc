@@ -0,0 +1,72 @@
+// Renders pages without a window, for machines with no display.
+
+#include "headless.h"
+
+#include <cstdlib>
+
+#include "../util.h"
+
+namespace headless {
+
+bool Offscreen::create(const layout::Rect& area) {
+  area_ = area;
+  if (software_) {
+    framebuffer_.create(area.width, area.height);
+    framebuffer_.setOrigin(area.x, area.y);
+    return true;
+  }
+  if (!texture_.create(area.width, area.height)) {
+    logger::error("Unable to create offscreen render texture");
+    return false;
+  }
+  // Draw in page coordinates, looking at the area.
+  texture_.setView(
+      sf::View(sf::FloatRect(area.x, area.y, area.width, area.height)));
+  return true;
+}
+
+void Offscreen::paint(const DisplayList& list, bool batch_shapes,
+                      bool batch_text) {
+  if (software_) {
+    framebuffer_.clear(sf::Color::Black);
+    list.replay(&framebuffer_, area_);
+    return;
+  }
+  texture_.clear(sf::Color::Black);
+  list.replay(&texture_, area_, batch_shapes, batch_text);
+}
+
+sf::Image Offscreen::capture() {
+  if (software_) {
+    sf::Image image;
+    framebuffer_.copyToImage(&image);
+    return image;
+  }
+  texture_.display();
+  return texture_.getTexture().copyToImage();
+}
+
+ImageDiff compareImages(const sf::Image& actual, const sf::Image& expected,
+                        int tolerance) {
+  ImageDiff diff;
+  sf::Vector2u size = actual.getSize();
+  if (size != expected.getSize()) {
+    diff.size_mismatch = true;
+    return diff;
+  }
+  diff.total_pixels = static_cast<long>(size.x) * size.y;
+  // Both images are tightly packed RGBA.
+  const sf::Uint8* a = actual.getPixelsPtr();
+  const sf::Uint8* b = expected.getPixelsPtr();
+  for (long i = 0; i < diff.total_pixels; i++) {
+    for (int channel = 0; channel < 4; channel++) {
+      if (std::abs(a[i * 4 + channel] - b[i * 4 + channel]) > tolerance) {
+        diff.differing_pixels++;
+        break;
+      }
+    }
+  }
+  return diff;
+}
+
+}  // namespace headless
@@ -0,0 +1,51 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "SFML/Graphics.hpp"
+
+#include "../layout.h"
+#include "paint.h"
+#include "raster.h"
+
+namespace headless {
+
+// An offscreen target showing one area of the page, for painting without a
+// window. It is either an SFML render texture or, with `software`, a
+// framebuffer in memory that needs no GL context.
+class Offscreen {
+  bool software_;
+  sf::RenderTexture texture_;
+  raster::Framebuffer framebuffer_;
+  layout::Rect area_;
+
+ public:
+  explicit Offscreen(bool software) : software_(software) {}
+  // Sizes the target to `area`, with the top left of the area at its origin.
+  // Returns false if it couldn't be created.
+  bool create(const layout::Rect& area);
+  const layout::Rect& get_area() const { return area_; }
+  // Clears the target and paints the ops of `list` inside its area.
+  void paint(const DisplayList& list, bool batch_shapes, bool batch_text);
+  // Returns a copy of what has been painted.
+  sf::Image capture();
+};
+
+// How far apart two images are.
+struct ImageDiff {
+  bool size_mismatch = false;
+  long differing_pixels = 0;
+  long total_pixels = 0;
+  double differingPercent() const {
+    return total_pixels == 0 ? 0 : 100.0 * differing_pixels / total_pixels;
+  }
+};
+
+// Compares two images pixel by pixel. Pixels whose channels all differ by at
+// most `tolerance` count as equal, so small differences in antialiasing
+// between machines don't fail a comparison.
+ImageDiff compareImages(const sf::Image& actual, const sf::Image& expected,
+                        int tolerance = 2);
+
+}  // namespace headless
+
+#endif
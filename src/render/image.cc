@@ -1,36 +1,218 @@
 #include "image.h"
 
-std::pair<float, float> getScalars(sf::Sprite sprite, int width, int height,
+#include <cmath>
+
+std::pair<float, float> getScalars(sf::Vector2u size, int width, int height,
                                    std::string style = "default") {
   float xScale = 1;
   float yScale = 1;
-  sf::FloatRect r = sprite.getGlobalBounds();
   if (height > 0 && width > 0) {
-    xScale = (float)width / r.width;
-    yScale = (float)height / r.height;
+    xScale = (float)width / size.x;
+    yScale = (float)height / size.y;
   } else if (width > 0) {
-    xScale = (float)width / r.width;
+    xScale = (float)width / size.x;
     yScale = xScale;
 
   } else if (height > 0) {
-    yScale = (float)height / r.height;
+    yScale = (float)height / size.y;
     xScale = yScale;
   }
   return std::pair<float, float>(xScale, yScale);
 }
 
 namespace image_render {
-void drawImage(sf::RenderWindow* window, const std::string& imageFile, int x,
+
+// Global static pointer to image cache
+ImageCache* ImageCache::instance_ = nullptr;
+
+ImageCache* ImageCache::getInstance() {
+  if (instance_ == nullptr) {
+    instance_ = new ImageCache;
+  }
+  return instance_;
+}
+
+void ImageCache::set_decode_threads(int threads) {
+  decoder_.reset();
+  pending_.clear();
+  if (threads > 0) {
+    decoder_.reset(new ImageDecoder(threads));
+  }
+}
+
+void ImageCache::request(const std::string& path) {
+  if (decoder_ == nullptr || index_.count(path) > 0 ||
+      !pending_.insert(path).second) {
+    return;
+  }
+  stats.misses++;
+  decoder_->submit(path);
+}
+
+void ImageCache::load(const std::string& path) {
+  if (decoder_ != nullptr) {
+    request(path);
+  } else if (index_.count(path) == 0) {
+    lookup(path);
+  }
+}
+
+const sf::Texture* ImageCache::get(const std::string& path) {
+  const Entry* entry = lookup(path);
+  return entry == nullptr ? nullptr : entry->texture.get();
+}
+
+const sf::Image* ImageCache::getImage(const std::string& path) {
+  const Entry* entry = lookup(path);
+  return entry == nullptr ? nullptr : entry->image.get();
+}
+
+const ImageCache::Entry* ImageCache::lookup(const std::string& path) {
+  auto it = index_.find(path);
+  if (it != index_.end()) {
+    stats.hits++;
+    it->second->frame = frame_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &*it->second;
+  }
+  if (decoder_ != nullptr) {
+    request(path);
+    stats.placeholders++;
+    return nullptr;
+  }
+  stats.misses++;
+  std::unique_ptr<sf::Image> image(new sf::Image);
+  if (!image->loadFromFile(path)) {
+    image.reset();
+  }
+  return &insert(path, std::move(image));
+}
+
+int ImageCache::collect() {
+  if (decoder_ == nullptr) {
+    return 0;
+  }
+  std::vector<ImageDecoder::Result> results;
+  decoder_->takeResults(&results);
+  for (ImageDecoder::Result& result : results) {
+    pending_.erase(result.path);
+    stats.decoded++;
+    // Images are uploaded here, on the window's thread.
+    insert(result.path, std::move(result.image));
+  }
+  return results.size();
+}
+
+void ImageCache::waitForPending() {
+  if (decoder_ != nullptr) {
+    decoder_->waitForAll();
+    collect();
+  }
+}
+
+const ImageCache::Entry& ImageCache::insert(
+    const std::string& path, std::unique_ptr<sf::Image> image) {
+  Entry entry;
+  entry.path = path;
+  entry.frame = frame_;
+  if (image != nullptr) {
+    sf::Vector2u size = image->getSize();
+    sizes_[path] = size;
+    if (keep_pixels_) {
+      entry.image = std::move(image);
+    } else {
+      entry.texture.reset(new sf::Texture);
+      if (!entry.texture->loadFromImage(*image)) {
+        entry.texture.reset();
+      }
+    }
+    entry.bytes = std::size_t(size.x) * size.y * 4;
+  }
+  if (entry.image == nullptr && entry.texture == nullptr) {
+    logger::error("Failed to load image: " + path);
+    entry.bytes = 0;
+  }
+  bytes_ += entry.bytes;
+  entries_.push_front(std::move(entry));
+  index_[path] = entries_.begin();
+  evict();
+  return entries_.front();
+}
+
+bool ImageCache::getSize(const std::string& path, int* width,
+                         int* height) const {
+  auto it = sizes_.find(path);
+  if (it == sizes_.end() || it->second.x == 0 || it->second.y == 0) {
+    return false;
+  }
+  *width = it->second.x;
+  *height = it->second.y;
+  return true;
+}
+
+void ImageCache::endFrame() {
+  frame_++;
+  evict();
+}
+
+void ImageCache::evict() {
+  // Entries are in order of use, so once the least recently used one is
+  // still on screen, all of them are.
+  while (bytes_ > budget_bytes_ && entries_.size() > 1 &&
+         entries_.back().frame + 1 < frame_) {
+    Entry& lru = entries_.back();
+    bytes_ -= lru.bytes;
+    index_.erase(lru.path);
+    entries_.pop_back();
+    stats.evictions++;
+  }
+}
+
+void ImageCache::set_budget_bytes(std::size_t bytes) {
+  budget_bytes_ = bytes;
+  evict();
+}
+
+void ImageCache::clear() {
+  logger::info("Clearing image cache");
+  decoder_.reset();
+  pending_.clear();
+  sizes_.clear();
+  entries_.clear();
+  index_.clear();
+  bytes_ = 0;
+}
+
+std::string resolvePath(const std::string& src) { return "examples/" + src; }
+
+bool drawImage(sf::RenderTarget* target, const std::string& imageFile, int x,
                int y, int width, int height) {
-  sf::Texture texture;
-  if (!texture.loadFromFile("examples/" + imageFile)) {
-    logger::error("Failed to load image: examples/" + imageFile);
+  const sf::Texture* texture =
+      ImageCache::getInstance()->get(resolvePath(imageFile));
+  if (texture == nullptr) {
+    return false;
   }
   sf::Sprite sprite;
-  sprite.setTexture(texture, true);
-  std::pair<float, float> scalars = getScalars(sprite, width, height);
+  sprite.setTexture(*texture, true);
+  std::pair<float, float> scalars =
+      getScalars(texture->getSize(), width, height);
   sprite.setPosition(sf::Vector2f(x, y));
   sprite.setScale(sf::Vector2f(scalars.first, scalars.second));
-  window->draw(sprite);
+  target->draw(sprite);
+  return true;
+}
+
+bool drawImage(raster::Framebuffer* framebuffer, const std::string& imageFile,
+               int x, int y, int width, int height) {
+  const sf::Image* image =
+      ImageCache::getInstance()->getImage(resolvePath(imageFile));
+  if (image == nullptr) {
+    return false;
+  }
+  sf::Vector2u size = image->getSize();
+  std::pair<float, float> scalars = getScalars(size, width, height);
+  framebuffer->drawImage(*image, x, y, std::lround(size.x * scalars.first),
+                         std::lround(size.y * scalars.second));
+  return true;
 }
 }  // namespace image_render
@@ -1,15 +1,136 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
 #include "SFML/Graphics.hpp"
 #include "SFML/Window.hpp"
 
 #include "../util.h"
+#include "decoder.h"
+#include "raster.h"
 
 namespace image_render {
 
-void drawImage(sf::RenderWindow* window, const std::string& imageFile,
+// Process-wide cache of decoded image textures, keyed by resolved path. Holds
+// at most a byte budget of pixels, evicting the least recently drawn images
+// first, so repainting doesn't read and decode every image again. Images
+// drawn in the current or the last frame are never evicted, even over budget,
+// so images that are on screen together can't keep evicting each other.
+//
+// Images are decoded on worker threads when there are any. Until an image
+// arrives it is missing from the cache, and the main loop picks up finished
+// decodes with collect().
+class ImageCache {
+  struct Entry {
+    std::string path;
+    // Null if the image couldn't be loaded, so a broken image is only tried
+    // once.
+    std::unique_ptr<sf::Texture> texture;
+    // Set instead of the texture when the cache keeps pixels.
+    std::unique_ptr<sf::Image> image;
+    std::size_t bytes = 0;
+    // The frame the image was last drawn in, or was added in.
+    unsigned long frame = 0;
+  };
+  // Most recently used first.
+  std::list<Entry> entries_;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+  // Paths submitted to the decoder that haven't been collected yet.
+  std::unordered_set<std::string> pending_;
+  // The size of every image decoded so far, kept after it is evicted.
+  std::unordered_map<std::string, sf::Vector2u> sizes_;
+  std::unique_ptr<ImageDecoder> decoder_;
+  std::size_t budget_bytes_ = 64 << 20;
+  std::size_t bytes_ = 0;
+  bool keep_pixels_ = false;
+  unsigned long frame_ = 1;
+  static ImageCache* instance_;
+  ImageCache() {}
+
+  ImageCache(const ImageCache&) = delete;
+  ImageCache& operator=(const ImageCache&) = delete;
+
+  // Returns the entry for the image at `path`, loading it on a miss, or null
+  // if it is still being decoded.
+  const Entry* lookup(const std::string& path);
+  // Adds a decoded image as the most recently used, uploading it unless the
+  // cache keeps pixels, and returns its entry.
+  const Entry& insert(const std::string& path,
+                      std::unique_ptr<sf::Image> image);
+  // Evicts least recently used images, other than the most recent one and
+  // those drawn in this frame or the last, until the cache fits in its
+  // budget.
+  void evict();
+
+ public:
+  struct Stats {
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+    // Images decoded in the background and collected.
+    long decoded = 0;
+    // Draws of an image that hadn't been decoded yet.
+    long placeholders = 0;
+  };
+  Stats stats;
+
+  static ImageCache* getInstance();
+  // Decodes images on `threads` worker threads. With none, images are
+  // decoded when they are first drawn.
+  void set_decode_threads(int threads);
+  // Keeps images as pixels in memory for the software rasterizer, rather
+  // than uploading them as textures. Must be set before any image is loaded.
+  void set_keep_pixels(bool keep_pixels) { keep_pixels_ = keep_pixels; }
+  // Starts loading the image at `path` if it isn't cached or loading already.
+  void request(const std::string& path);
+  // As request(), but without decoder threads loads the image right away
+  // rather than when it is first drawn.
+  void load(const std::string& path);
+  // Returns the texture for the image at `path`, or null if it can't be
+  // loaded or is still being decoded. A miss starts a load. The texture stays
+  // valid until the next call.
+  const sf::Texture* get(const std::string& path);
+  // As get(), for a cache that keeps pixels.
+  const sf::Image* getImage(const std::string& path);
+  // Adds images that finished decoding to the cache. Must be called on the
+  // thread that owns the window. Returns the number added.
+  int collect();
+  // Waits for every requested image to be decoded, then collects them.
+  void waitForPending();
+  // Called once a frame has been painted. Images that weren't drawn in it
+  // or the frame before may then be evicted.
+  void endFrame();
+  std::size_t get_pending_count() const { return pending_.size(); }
+  // Gets the size of the image at `path` if it has been decoded. Returns false
+  // if it hasn't, or couldn't be.
+  bool getSize(const std::string& path, int* width, int* height) const;
+  // The number of images whose size is known. Grows whenever an image is
+  // decoded for the first time.
+  std::size_t get_size_count() const { return sizes_.size(); }
+  // Sets the number of bytes of decoded pixels to keep. The image drawn most
+  // recently is kept even if it alone is over budget.
+  void set_budget_bytes(std::size_t bytes);
+  std::size_t get_bytes() const { return bytes_; }
+  std::size_t get_count() const { return entries_.size(); }
+  // Stops the decoder and empties the cache.
+  void clear();
+};
+
+// Returns the path of an image referenced by a document.
+std::string resolvePath(const std::string& src);
+
+// Draws an image, scaled to the given size. Returns false, drawing nothing,
+// if the image isn't available yet or can't be loaded.
+bool drawImage(sf::RenderTarget* target, const std::string& imageFile,
+               int x = 0, int y = 0, int width = -1, int height = -1);
+bool drawImage(raster::Framebuffer* framebuffer, const std::string& imageFile,
                int x = 0, int y = 0, int width = -1, int height = -1);
-}
+}  // namespace image_render
 
 #endif
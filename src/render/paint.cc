@@ -1,142 +1,320 @@
 #include "paint.h"
 
+#include <cmath>
+
+#include "absl/strings/str_format.h"
+
+#include "../trace.h"
 #include "../util.h"
 #include "image.h"
 #include "shape.h"
+#include "text.h"
+
+namespace {
+
+PaintStats paint_stats;
+
+// Drawn in place of an image that hasn't been decoded yet.
+const sf::Color kPlaceholderColor(220, 220, 220);
+
+// Bounds the work of checking each shape against the deferred text.
+const std::size_t kMaxDeferredOps = 256;
+
+// Adds the part of `rect` inside `area` to `batch`.
+void addClippedRect(const layout::Rect &rect, const layout::Rect &area,
+                    sf::Color color, shape_render::ShapeBatch *batch) {
+  int x0 = std::max(area.x, rect.x);
+  int x1 = std::min(area.x + area.width, rect.x + rect.width);
+  int y0 = std::max(area.y, rect.y);
+  int y1 = std::min(area.y + area.height, rect.y + rect.height);
+  if (x0 < x1 && y0 < y1) {
+    batch->addRect(x0, y0, x1, y1, color);
+  }
+}
+
+}  // namespace
+
+const PaintStats &getPaintStats() { return paint_stats; }
+
+void resetPaintStats() { paint_stats = PaintStats(); }
+
+void DisplayList::clear() {
+  ops_.clear();
+  texts_.clear();
+  glyph_runs_.clear();
+  images_.clear();
+  index_.build({});
+}
+
+void DisplayList::addRect(const layout::LayoutElement &box,
+                          const layout::Rect &rect, sf::Color color,
+                          int border_radius) {
+  PaintOp op;
+  op.type = PaintOpType::Rect;
+  op.box = &box;
+  op.color = color;
+  op.border_radius = border_radius;
+  op.rect = rect;
+  ops_.push_back(op);
+}
+
+void DisplayList::addText(const layout::LayoutElement &box,
+                          const layout::Rect &rect, sf::Text *text) {
+  PaintOp op;
+  op.type = PaintOpType::Text;
+  op.box = &box;
+  op.resource = texts_.size();
+  text->setPosition(std::max(0, rect.x), std::max(0, rect.y));
+  // Glyphs can reach outside the line box, for example when the line height
+  // is smaller than the font, so the op covers both.
+  sf::FloatRect glyphs = text->getGlobalBounds();
+  int x0 = std::min<int>(rect.x, std::floor(glyphs.left));
+  int y0 = std::min<int>(rect.y, std::floor(glyphs.top));
+  int x1 = std::max<int>(rect.x + rect.width,
+                         std::ceil(glyphs.left + glyphs.width));
+  int y1 = std::max<int>(rect.y + rect.height,
+                         std::ceil(glyphs.top + glyphs.height));
+  op.rect.x = x0;
+  op.rect.y = y0;
+  op.rect.width = x1 - x0;
+  op.rect.height = y1 - y0;
+  texts_.push_back(text);
+  glyph_runs_.emplace_back();
+  ops_.push_back(op);
+}
+
+void DisplayList::addImage(const layout::LayoutElement &box,
+                           const layout::Rect &rect, const std::string &src) {
+  PaintOp op;
+  op.type = PaintOpType::Image;
+  op.box = &box;
+  op.rect = rect;
+  op.resource = images_.size();
+  images_.push_back(src);
+  ops_.push_back(op);
+}
 
-RenderShape::~RenderShape() {
-  std::cout << "Destructing render shape" << std::endl;
+void DisplayList::buildIndex() {
+  std::vector<layout::Rect> rects;
+  rects.reserve(ops_.size());
+  for (const PaintOp &op : ops_) {
+    rects.push_back(op.rect);
+  }
+  index_.build(std::move(rects));
+}
+
+const layout::LayoutElement *DisplayList::hitTest(int x, int y) const {
+  int op = index_.queryPoint(x, y);
+  return op == -1 ? nullptr : ops_[op].box;
+}
+
+const text_render::GlyphRun &DisplayList::getGlyphRun(
+    const PaintOp &op) const {
+  std::unique_ptr<text_render::GlyphRun> &run = glyph_runs_[op.resource];
+  if (run == nullptr) {
+    run.reset(new text_render::GlyphRun);
+    text_render::buildGlyphRun(*texts_[op.resource], run.get());
+  }
+  return *run;
 }
 
-RenderImage::~RenderImage() {
-  std::cout << "Destructing render image" << std::endl;
+void DisplayList::replay(sf::RenderTarget *target, const layout::Rect &area,
+                         bool batch_shapes, bool batch_text) const {
+  TRACE_SPAN("replay");
+  shape_render::ShapeBatch batch;
+  text_render::TextBatch text_batch;
+  // Text drawn since the batch was started. It can wait until after the
+  // batch is drawn as long as no shape added after it overlaps it.
+  std::vector<const PaintOp *> deferred;
+  auto flush = [&]() {
+    if (!batch.empty()) {
+      batch.draw(target);
+      paint_stats.draw_calls++;
+    }
+    if (batch_text) {
+      for (const PaintOp *op : deferred) {
+        text_batch.add(getGlyphRun(*op));
+      }
+      paint_stats.draw_calls += text_batch.draw(target);
+    } else {
+      for (const PaintOp *op : deferred) {
+        target->draw(*texts_[op->resource]);
+        paint_stats.draw_calls++;
+      }
+    }
+    deferred.clear();
+  };
+  index_.query(area, &visible_);
+  paint_stats.ops_culled += ops_.size() - visible_.size();
+  for (int i : visible_) {
+    const PaintOp &op = ops_[i];
+    paint_stats.ops_replayed++;
+    const layout::Rect &r = op.rect;
+    switch (op.type) {
+      case PaintOpType::Rect: {
+        for (const PaintOp *text : deferred) {
+          if (spatial::intersects(r, text->rect)) {
+            flush();
+            paint_stats.batch_breaks++;
+            break;
+          }
+        }
+        if (op.border_radius > 0) {
+          // Rounded corners belong to the whole rect, wherever the area cuts
+          // it, so the target clips it instead.
+          batch.addRect(r.x, r.y, r.x + r.width, r.y + r.height, op.color,
+                        op.border_radius);
+        } else {
+          addClippedRect(r, area, op.color, &batch);
+        }
+        break;
+      }
+      case PaintOpType::Text:
+        // Text in another font or size is drawn by another call, so it
+        // mustn't overlap text deferred before it.
+        if (batch_text) {
+          const sf::Texture *texture = getGlyphRun(op).texture;
+          for (const PaintOp *text : deferred) {
+            if (getGlyphRun(*text).texture != texture &&
+                spatial::intersects(r, text->rect)) {
+              flush();
+              paint_stats.batch_breaks++;
+              break;
+            }
+          }
+        }
+        deferred.push_back(&op);
+        if (deferred.size() >= kMaxDeferredOps) {
+          flush();
+        }
+        break;
+      case PaintOpType::Image:
+        // An image with no explicit size is drawn at its natural size, which
+        // its rect doesn't describe, so nothing is reordered around it.
+        flush();
+        if (image_render::drawImage(target, images_[op.resource], r.x, r.y,
+                                    r.width, r.height)) {
+          paint_stats.draw_calls++;
+        } else {
+          // Hold the image's place until it has been decoded.
+          addClippedRect(r, area, kPlaceholderColor, &batch);
+        }
+        break;
+    }
+    if (!batch_shapes) {
+      flush();
+    }
+  }
+  flush();
+}
+
+void DisplayList::replay(raster::Framebuffer *framebuffer,
+                         const layout::Rect &area) const {
+  TRACE_SPAN("replay");
+  // Every op is drawn as soon as it is visited, so there is nothing to batch
+  // or reorder.
+  index_.query(area, &visible_);
+  paint_stats.ops_culled += ops_.size() - visible_.size();
+  for (int i : visible_) {
+    const PaintOp &op = ops_[i];
+    paint_stats.ops_replayed++;
+    const layout::Rect &r = op.rect;
+    switch (op.type) {
+      case PaintOpType::Rect:
+        shape_render::drawRect(framebuffer, r.x, r.y, r.x + r.width,
+                               r.y + r.height, op.color, op.border_radius);
+        break;
+      case PaintOpType::Text:
+        text_render::drawText(framebuffer, *texts_[op.resource]);
+        break;
+      case PaintOpType::Image:
+        if (!image_render::drawImage(framebuffer, images_[op.resource], r.x,
+                                     r.y, r.width, r.height)) {
+          shape_render::drawRect(framebuffer, r.x, r.y, r.x + r.width,
+                                 r.y + r.height, kPlaceholderColor);
+        }
+        break;
+    }
+  }
 }
 
-RenderText::~RenderText() {
-  std::cout << "Destructing render text" << std::endl;
+std::string DisplayList::toLogStr() const {
+  std::string str;
+  for (const PaintOp &op : ops_) {
+    const layout::Rect &r = op.rect;
+    switch (op.type) {
+      case PaintOpType::Rect:
+        str += "Rect: ";
+        break;
+      case PaintOpType::Text:
+        str += "Text: '" + texts_[op.resource]->getString().toAnsiString() +
+               "' ";
+        break;
+      case PaintOpType::Image:
+        str += "Image: src='" + images_[op.resource] + "' ";
+        break;
+    }
+    str += absl::StrFormat("x=%d, y=%d, width=%d, height=%d", r.x, r.y,
+                           r.width, r.height);
+    if (op.type == PaintOpType::Rect) {
+      str += ", " + color::toLogStr(op.color);
+    }
+    str += "\n";
+  }
+  return str;
 }
 
-void Renderer::renderLayout(layout::LayoutElement &box,
-                            sf::RenderWindow *window) {
+void Renderer::renderLayout(layout::LayoutElement &box) {
+  TRACE_SPAN("renderLayout");
   if (box.get_display_type() == style::Invisible) {
     return;
   } else if (box.get_box_type() == layout::Img) {
-    renderImage(box, window);
+    renderImage(box);
   } else if (box.get_box_type() == layout::Text) {
-    renderText(box, window);
+    renderText(box);
   } else if (box.get_box_type() == layout::Bullet) {
-    renderBullet(box, window);
+    renderBullet(box);
   } else {
-    renderShape(box, window);
+    renderShape(box);
   }
-  for (auto child : box.get_children()) {
-    renderLayout(child, window);
+  for (layout::LayoutElement &child : box.get_children()) {
+    renderLayout(child);
   }
 }
-void Renderer::renderBullet(const layout::LayoutElement &box,
-                            sf::RenderWindow *window) {
-  sf::Color color = color::getColor(box, constants::css_properties::COLOR);
+void Renderer::renderBullet(const layout::LayoutElement &box) {
+  sf::Color color = color::unpack(box.get_style().color, sf::Color::White);
   layout::Rect r = box.dimensions.paddingBox();
   layout::Rect bullet_rect;
   bullet_rect.x = r.x;
   bullet_rect.y = r.y + r.height / 2;
   bullet_rect.height = 5;
   bullet_rect.width = 5;
-  RenderShape command = RenderShape("Bullet", bullet_rect, color, 0);
-  command.paint(window);
-}
-void Renderer::renderShape(const layout::LayoutElement &box,
-                           sf::RenderWindow *window) {
-  int borderRadius = std::stoi(
-      box.getStyleValue(constants::css_properties::BORDER_RADIUS, "0"));
-  sf::Color b_color =
-      color::getColor(box, constants::css_properties::BORDER_COLOR);
-  RenderShape command_inner("Border", box.dimensions.borderBox(), b_color,
-                            borderRadius);
-  command_inner.paint(window);
-  command_inner.log();
-
-  sf::Color bg_color =
-      color::getColor(box, constants::css_properties::BACKGROUND_COLOR);
-  RenderShape command("Rect", box.dimensions.paddingBox(), bg_color,
-                      borderRadius);
-  command.paint(window);
-}
-void Renderer::renderImage(const layout::LayoutElement &box,
-                           sf::RenderWindow *window) {
-  RenderImage command("Image", box.dimensions.borderBox(), box.get_raw_data());
-  command.paint(window);
-}
-void Renderer::renderText(layout::LayoutElement &box,
-                          sf::RenderWindow *window) {
-  sf::Color color =
-      color::getColor(box, constants::css_properties::BACKGROUND_COLOR);
-  RenderText command("Text", box.dimensions.borderBox(), color,
-                     box.take_text_node(), box.get_raw_data());
-  command.paint(window);
-}
-
-void RenderShape::paint(sf::RenderWindow *window) {
-  sf::Vector2u size = window->getSize();
-  int windowWidth = size.x;
-  int windowHeight = size.y;
-  int x0 = std::max(0, rect_.x);
-  int x1 = std::min(windowWidth, rect_.x + rect_.width);
-  int y0 = std::max(0, rect_.y);
-  int y1 = std::min(windowHeight, rect_.y + rect_.height);
-  shape_render::drawRect(window, x0, y0, x1, y1, color_, border_radius_);
-  log();
-}
-
-void RenderText::paint(sf::RenderWindow *window) {
-  int x0 = std::max(0, rect_.x);
-  int y0 = std::max(0, rect_.y);
-  std::unique_ptr<sf::Text> text = take_text_node();
-  text->setPosition(x0, y0);
-  window->draw(*text);
-  log();
-}
-
-void RenderImage::paint(sf::RenderWindow *window) {
-  image_render::drawImage(window, src_, rect_.x, rect_.y, rect_.width,
-                          rect_.height);
-  log();
-}
-
-std::string RenderCommand::coords() {
-  std::string str = "... x=" + std::to_string(rect_.x) +
-                    ", y=" + std::to_string(rect_.y) + ", width=";
-  str += std::to_string(rect_.width) +
-         ", height=" + std::to_string(rect_.height) + ", ";
-  return str;
+  list_->addRect(box, bullet_rect, color, 0);
 }
-
-void RenderText::log() {
-  std::string str = "Command= " + command_type_ + ": ";
-  str += "'" + raw_text_ + "'";
-  str += RenderCommand::coords();
-  str += color::toLogStr(color_);
-  logger::info(str);
+void Renderer::renderShape(const layout::LayoutElement &box) {
+  const style::ComputedStyle &style = box.get_style();
+  int borderRadius = style.border_radius;
+  sf::Color b_color = color::unpack(style.border_color, sf::Color::White);
+  list_->addRect(box, box.dimensions.borderBox(), b_color, borderRadius);
+  sf::Color bg_color =
+      color::unpack(style.background_color, sf::Color::White);
+  list_->addRect(box, box.dimensions.paddingBox(), bg_color,
+                 borderRadius);
 }
-
-void RenderImage::log() {
-  std::string str = "Command= " + command_type_ + ": ";
-  str += "src='" + src_ + "'";
-  str += RenderCommand::coords();
-  logger::info(str);
+void Renderer::renderImage(const layout::LayoutElement &box) {
+  list_->addImage(box, box.dimensions.borderBox(), box.get_raw_data());
 }
-
-void RenderShape::log() {
-  std::string str = "Command= " + command_type_ + ": ";
-  str += RenderCommand::coords();
-  str += color::toLogStr(color_);
-  logger::info(str);
+void Renderer::renderText(layout::LayoutElement &box) {
+  // Draw the run one line at a time.
+  const std::vector<layout::TextLine> &lines = box.get_text_lines();
+  for (int i = 0; i < lines.size(); i++) {
+    list_->addText(box, lines[i].rect, &box.getLineTextNode(i));
+  }
 }
 
-void paint(layout::LayoutElement &layoutRoot, layout::Rect bounds,
-           sf::RenderWindow *window) {
-  logger::info("****** Painting canvas ******");
-  Renderer Renderer;
-  Renderer.renderLayout(layoutRoot, window);
-  window->display();
+void buildDisplayList(layout::LayoutElement &layoutRoot, DisplayList *list) {
+  list->clear();
+  Renderer renderer(list);
+  renderer.renderLayout(layoutRoot);
+  list->buildIndex();
 }
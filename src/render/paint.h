@@ -1,6 +1,8 @@
 #ifndef PAINT_H
 #define PAINT_H
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 #include "SFML/Graphics.hpp"
@@ -9,80 +11,110 @@
 #include "../color.h"
 #include "../layout.h"
 #include "../parse/css.h"
+#include "raster.h"
+#include "spatial.h"
+#include "text.h"
 
-class RenderCommand {
- protected:
-  std::string command_type_;
-  layout::Rect rect_;
+enum class PaintOpType : uint8_t { Rect, Text, Image };
 
- public:
-  RenderCommand(std::string command_type, layout::Rect rect) {
-    command_type_ = command_type;
-    rect_ = rect;
-  }
-  std::string coords();
-  void virtual paint(sf::RenderWindow* window){};
+// A single drawing operation. Ops are small and flat, so painting a frame is
+// a walk over one vector.
+struct PaintOp {
+  PaintOpType type;
+  sf::Color color;
+  int border_radius = 0;
+  // The area the op draws to. For text this covers both the line box and the
+  // glyphs.
+  layout::Rect rect;
+  // Index of the op's text or image in its display list.
+  uint32_t resource = 0;
+  // The layout box the op paints.
+  const layout::LayoutElement* box = nullptr;
 };
 
-class RenderShape : public RenderCommand {
-  int border_radius_;
-  sf::Color color_;
-
- public:
-  RenderShape(std::string command_type, layout::Rect rect, sf::Color color,
-              int border_radius)
-      : RenderCommand(command_type, rect) {
-    color_ = color;
-    border_radius_ = border_radius;
-  };
-  ~RenderShape();
-  void paint(sf::RenderWindow* window);
-  void log();
+// Counters describing the work done by the last replays.
+struct PaintStats {
+  long ops_replayed = 0;
+  // Ops skipped because they were outside the window.
+  long ops_culled = 0;
+  long draw_calls = 0;
+  // Batches drawn early because a later shape overlapped text or an image
+  // drawn before it, or text overlapped text in another font or size.
+  long batch_breaks = 0;
 };
 
-class RenderText : public RenderCommand {
-  std::unique_ptr<sf::Text> text_node_;
-  std::string raw_text_;
-  sf::Color color_;
+const PaintStats& getPaintStats();
+void resetPaintStats();
 
- public:
-  RenderText(std::string command_type, layout::Rect rect, sf::Color color,
-             std::unique_ptr<sf::Text> text_node, std::string raw_text)
-      : RenderCommand(command_type, rect) {
-    color_ = color;
-    text_node_ = std::move(text_node);
-    raw_text_ = raw_text;
-  };
-  std::unique_ptr<sf::Text> take_text_node() { return std::move(text_node_); };
-  ~RenderText();
-  void paint(sf::RenderWindow* window);
-  void log();
-};
+// The paint ops for one layout of a page, in paint order. A display list is
+// recorded once per layout and replayed for every frame until the layout
+// changes. Ops are indexed by the area they draw to, so a replay only visits
+// the ops inside the window.
+class DisplayList {
+  std::vector<PaintOp> ops_;
+  // Text objects are owned by the layout tree, and already positioned.
+  std::vector<sf::Text*> texts_;
+  // Each text's glyphs, built the first time it is replayed to an SFML
+  // target.
+  mutable std::vector<std::unique_ptr<text_render::GlyphRun>> glyph_runs_;
+  std::vector<std::string> images_;
+  spatial::GridIndex index_;
+  // Scratch space for the ops a replay visits.
+  mutable std::vector<int> visible_;
 
-class RenderImage : public RenderCommand {
-  std::string src_;
+  const text_render::GlyphRun& getGlyphRun(const PaintOp& op) const;
 
  public:
-  RenderImage(std::string command_type, layout::Rect rect, std::string src)
-      : RenderCommand(command_type, rect) {
-    src_ = src;
-  };
-  ~RenderImage();
-  void paint(sf::RenderWindow* window);
-  void log();
+  void clear();
+  void addRect(const layout::LayoutElement& box, const layout::Rect& rect,
+               sf::Color color, int border_radius);
+  void addText(const layout::LayoutElement& box, const layout::Rect& rect,
+               sf::Text* text);
+  void addImage(const layout::LayoutElement& box, const layout::Rect& rect,
+                const std::string& src);
+  // Indexes the ops added since the last clear(). Must be called before the
+  // list is replayed or hit-tested.
+  void buildIndex();
+
+  const std::vector<PaintOp>& get_ops() const { return ops_; }
+  const sf::Text& get_text(const PaintOp& op) const {
+    return *texts_[op.resource];
+  }
+  const std::string& get_image(const PaintOp& op) const {
+    return images_[op.resource];
+  }
+
+  // Draws the ops that intersect `area` of the page to `target`, whose view
+  // must map page coordinates. With `batch_shapes`, rects are collected into
+  // as few draw calls as the paint order allows; otherwise each is drawn on
+  // its own. With `batch_text`, the glyphs of every line drawn between two
+  // shape batches are drawn with one call per font and size; otherwise each
+  // line is a draw call.
+  void replay(sf::RenderTarget* target, const layout::Rect& area,
+              bool batch_shapes = true, bool batch_text = true) const;
+  // Draws the ops that intersect `area` of the page into a software
+  // framebuffer, whose origin must be the page coordinates of its top left.
+  void replay(raster::Framebuffer* framebuffer,
+              const layout::Rect& area) const;
+  // Returns the box painted on top at a point, or null if there is none.
+  const layout::LayoutElement* hitTest(int x, int y) const;
+  std::string toLogStr() const;
 };
 
+// Records the display list for a laid out tree.
 class Renderer {
-  void renderShape(const layout::LayoutElement&, sf::RenderWindow* window);
-  void renderImage(const layout::LayoutElement&, sf::RenderWindow* window);
-  void renderBullet(const layout::LayoutElement&, sf::RenderWindow* window);
-  void renderText(layout::LayoutElement&, sf::RenderWindow* window);
+  DisplayList* list_;
+  void renderShape(const layout::LayoutElement&);
+  void renderImage(const layout::LayoutElement&);
+  void renderBullet(const layout::LayoutElement&);
+  void renderText(layout::LayoutElement&);
 
  public:
-  void renderLayout(layout::LayoutElement&, sf::RenderWindow* window);
+  Renderer(DisplayList* list) : list_(list){};
+  void renderLayout(layout::LayoutElement&);
 };
 
-void paint(layout::LayoutElement& layoutRoot, layout::Rect bounds,
-           sf::RenderWindow* window);
+// Replaces the contents of `list` with the paint ops for `layoutRoot`.
+void buildDisplayList(layout::LayoutElement& layoutRoot, DisplayList* list);
 
 #endif
@@ -0,0 +1,179 @@
+#include "raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "../simd.h"
+
+namespace raster {
+
+namespace {
+
+uint32_t pack(sf::Color color) {
+  const uint8_t bytes[4] = {color.r, color.g, color.b, color.a};
+  uint32_t pixel;
+  std::memcpy(&pixel, bytes, sizeof(pixel));
+  return pixel;
+}
+
+// Returns x / 255, rounded, for x up to 255 * 255.
+inline int div255(int x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+// Returns `src` drawn over `dst` with coverage `alpha`. The result is opaque
+// where either is.
+inline uint32_t blendPixel(uint32_t dst, uint32_t src, int alpha) {
+  uint8_t d[4];
+  uint8_t s[4];
+  std::memcpy(d, &dst, sizeof(d));
+  std::memcpy(s, &src, sizeof(s));
+  for (int channel = 0; channel < 3; channel++) {
+    d[channel] = div255(s[channel] * alpha + d[channel] * (255 - alpha));
+  }
+  d[3] = div255(255 * alpha + d[3] * (255 - alpha));
+  std::memcpy(&dst, d, sizeof(dst));
+  return dst;
+}
+
+void fillOpaque(uint32_t *row, int count, uint32_t pixel) {
+  int i = 0;
+#ifdef SIMD_SSE2
+  const __m128i pixels = _mm_set1_epi32(pixel);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(row + i), pixels);
+  }
+#endif
+  for (; i < count; i++) {
+    row[i] = pixel;
+  }
+}
+
+}  // namespace
+
+void Framebuffer::create(int width, int height) {
+  width_ = std::max(0, width);
+  height_ = std::max(0, height);
+  pixels_.assign(std::size_t(width_) * height_, pack(sf::Color::Black));
+}
+
+void Framebuffer::setOrigin(int x, int y) {
+  origin_x_ = x;
+  origin_y_ = y;
+}
+
+void Framebuffer::clear(sf::Color color) {
+  fillOpaque(pixels_.data(), pixels_.size(), pack(color));
+}
+
+void Framebuffer::fillSpan(int y, int x0, int x1, sf::Color color) {
+  fillRect(x0, y, x1, y + 1, color);
+}
+
+void Framebuffer::fillRect(int x0, int y0, int x1, int y1, sf::Color color) {
+  x0 = std::max(0, x0 - origin_x_);
+  x1 = std::min(width_, x1 - origin_x_);
+  y0 = std::max(0, y0 - origin_y_);
+  y1 = std::min(height_, y1 - origin_y_);
+  if (x0 >= x1 || y0 >= y1 || color.a == 0) {
+    return;
+  }
+  uint32_t pixel = pack(color);
+  for (int y = y0; y < y1; y++) {
+    uint32_t *row = &pixels_[std::size_t(y) * width_ + x0];
+    if (color.a == 255) {
+      fillOpaque(row, x1 - x0, pixel);
+    } else {
+      // Painting only fills opaque rects, so translucent ones needn't be
+      // fast.
+      for (int x = 0; x < x1 - x0; x++) {
+        row[x] = blendPixel(row[x], pixel, color.a);
+      }
+    }
+  }
+}
+
+void Framebuffer::fillMask(int x, int y, const uint8_t *mask, int width,
+                           int height, int stride, sf::Color color,
+                           float shear, int baseline) {
+  uint32_t pixel = pack(color);
+  for (int row = 0; row < height; row++) {
+    int py = y + row - origin_y_;
+    if (py < 0 || py >= height_) {
+      continue;
+    }
+    int shift = std::lround(shear * (baseline - (y + row)));
+    int px0 = x + shift - origin_x_;
+    int c0 = std::max(0, -px0);
+    int c1 = std::min(width, width_ - px0);
+    if (c0 >= c1) {
+      continue;
+    }
+    const uint8_t *coverage = mask + std::size_t(row) * stride;
+    // Index from the first visible column: the mask's left edge can be
+    // outside the buffer.
+    uint32_t *dst = &pixels_[std::size_t(py) * width_ + px0 + c0];
+    for (int c = c0; c < c1; c++) {
+      int alpha = div255(coverage[c] * color.a);
+      if (alpha == 255) {
+        dst[c - c0] = pixel;
+      } else if (alpha > 0) {
+        dst[c - c0] = blendPixel(dst[c - c0], pixel, alpha);
+      }
+    }
+  }
+}
+
+void Framebuffer::drawImage(const sf::Image &image, int x, int y, int width,
+                            int height) {
+  sf::Vector2u size = image.getSize();
+  if (width <= 0 || height <= 0 || size.x == 0 || size.y == 0) {
+    return;
+  }
+  int px0 = std::max(0, x - origin_x_);
+  int px1 = std::min(width_, x + width - origin_x_);
+  int py0 = std::max(0, y - origin_y_);
+  int py1 = std::min(height_, y + height - origin_y_);
+  if (px0 >= px1 || py0 >= py1) {
+    return;
+  }
+  // The source column is the same on every row.
+  std::vector<int> columns(px1 - px0);
+  for (int px = px0; px < px1; px++) {
+    columns[px - px0] =
+        (static_cast<long>(px + origin_x_ - x) * size.x) / width;
+  }
+  const uint8_t *src = image.getPixelsPtr();
+  for (int py = py0; py < py1; py++) {
+    int sy = (static_cast<long>(py + origin_y_ - y) * size.y) / height;
+    const uint8_t *src_row = src + std::size_t(sy) * size.x * 4;
+    uint32_t *dst = &pixels_[std::size_t(py) * width_];
+    for (int px = px0; px < px1; px++) {
+      uint32_t pixel;
+      std::memcpy(&pixel, src_row + columns[px - px0] * 4, sizeof(pixel));
+      int alpha = src_row[columns[px - px0] * 4 + 3];
+      if (alpha == 255) {
+        dst[px] = pixel;
+      } else if (alpha > 0) {
+        dst[px] = blendPixel(dst[px], pixel, alpha);
+      }
+    }
+  }
+}
+
+void Framebuffer::copyToImage(sf::Image *image) const {
+  image->create(width_, height_,
+                reinterpret_cast<const sf::Uint8 *>(pixels_.data()));
+}
+
+const char *getImplementationName() {
+#ifdef SIMD_SSE2
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+}  // namespace raster
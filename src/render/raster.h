@@ -0,0 +1,51 @@
+// A software rasterizer that paints into a plain RGBA buffer in memory, for
+// machines without a GPU.
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "SFML/Graphics.hpp"
+
+namespace raster {
+
+// An RGBA pixel buffer showing one area of the page. Drawing functions take
+// page coordinates and clip to the buffer. Colors with an alpha below 255 are
+// blended over what is already there.
+class Framebuffer {
+  int width_ = 0;
+  int height_ = 0;
+  // The page coordinates of the top left pixel.
+  int origin_x_ = 0;
+  int origin_y_ = 0;
+  // Each pixel's bytes are in RGBA order, as in an sf::Image.
+  std::vector<uint32_t> pixels_;
+
+ public:
+  void create(int width, int height);
+  void setOrigin(int x, int y);
+  int get_width() const { return width_; }
+  int get_height() const { return height_; }
+  void clear(sf::Color color);
+  // Fills row `y` from `x0` up to but not including `x1`.
+  void fillSpan(int y, int x0, int x1, sf::Color color);
+  void fillRect(int x0, int y0, int x1, int y1, sf::Color color);
+  // Blends `color` through an 8-bit coverage mask, with the top left of the
+  // mask at (x, y). Each row is moved right by `shear` times its distance
+  // above `baseline`, for slanting glyphs.
+  void fillMask(int x, int y, const uint8_t* mask, int width, int height,
+                int stride, sf::Color color, float shear = 0,
+                int baseline = 0);
+  // Draws `image` scaled to `width` x `height`, sampling the nearest pixel.
+  void drawImage(const sf::Image& image, int x, int y, int width, int height);
+  void copyToImage(sf::Image* image) const;
+};
+
+// Returns the name of the span kernels in use, for logging.
+const char* getImplementationName();
+
+}  // namespace raster
+
+#endif
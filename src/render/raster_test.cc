@@ -0,0 +1,173 @@
+// Checks that the software rasterizer clips masks to the framebuffer.
+
+#include "raster.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace raster {
+namespace {
+
+const int kWidth = 8;
+const int kHeight = 6;
+
+// A fully covered mask, in rows further apart than its width, so the stride
+// is used.
+class Mask {
+  std::vector<uint8_t> coverage_;
+
+ public:
+  static const int kStride = 16;
+  Mask(int width, int height, uint8_t coverage = 255)
+      : coverage_(kStride * height) {
+    for (int row = 0; row < height; row++) {
+      std::fill_n(&coverage_[row * kStride], width, coverage);
+    }
+  }
+  const uint8_t* get() const { return coverage_.data(); }
+};
+
+// Returns the framebuffer as rows of '#' for pixels that were drawn and '.'
+// for ones still black.
+std::vector<std::string> drawnPixels(const Framebuffer& framebuffer) {
+  sf::Image image;
+  framebuffer.copyToImage(&image);
+  const sf::Uint8* pixels = image.getPixelsPtr();
+  std::vector<std::string> rows;
+  for (int y = 0; y < framebuffer.get_height(); y++) {
+    std::string row;
+    for (int x = 0; x < framebuffer.get_width(); x++) {
+      const sf::Uint8* pixel = pixels + (y * framebuffer.get_width() + x) * 4;
+      row += pixel[0] != 0 ? '#' : '.';
+    }
+    rows.push_back(row);
+  }
+  return rows;
+}
+
+class FillMaskTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    framebuffer_.create(kWidth, kHeight);
+    framebuffer_.clear(sf::Color::Black);
+  }
+
+  void fill(int x, int y, int width, int height, float shear = 0,
+            int baseline = 0) {
+    Mask mask(width, height);
+    framebuffer_.fillMask(x, y, mask.get(), width, height, Mask::kStride,
+                          sf::Color::White, shear, baseline);
+  }
+
+  Framebuffer framebuffer_;
+};
+
+TEST_F(FillMaskTest, Inside) {
+  fill(2, 1, 3, 2);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "........",
+                                           "..###...",
+                                           "..###...",
+                                           "........",
+                                           "........",
+                                           "........",
+                                       }));
+}
+
+TEST_F(FillMaskTest, PastLeftAndTopEdges) {
+  fill(-2, -1, 4, 3);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "##......",
+                                           "##......",
+                                           "........",
+                                           "........",
+                                           "........",
+                                           "........",
+                                       }));
+}
+
+TEST_F(FillMaskTest, PastRightAndBottomEdges) {
+  fill(6, 4, 4, 3);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "........",
+                                           "........",
+                                           "........",
+                                           "........",
+                                           "......##",
+                                           "......##",
+                                       }));
+}
+
+TEST_F(FillMaskTest, WiderThanBuffer) {
+  fill(-3, 2, kWidth + 6, 1);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "........",
+                                           "........",
+                                           "########",
+                                           "........",
+                                           "........",
+                                           "........",
+                                       }));
+}
+
+TEST_F(FillMaskTest, EntirelyOutside) {
+  fill(-10, 0, 4, 4);
+  fill(kWidth, 0, 4, 4);
+  fill(0, -10, 4, 4);
+  fill(0, kHeight, 4, 4);
+  EXPECT_EQ(drawnPixels(framebuffer_),
+            std::vector<std::string>(kHeight, std::string(kWidth, '.')));
+}
+
+TEST_F(FillMaskTest, ShearAcrossLeftEdge) {
+  // Rows above the baseline move right by their height above it, so the
+  // top row starts inside the buffer and the bottom one outside it.
+  fill(-2, 0, 3, 4, /*shear=*/1, /*baseline=*/3);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           ".###....",
+                                           "###.....",
+                                           "##......",
+                                           "#.......",
+                                           "........",
+                                           "........",
+                                       }));
+}
+
+TEST_F(FillMaskTest, ShearAcrossRightEdge) {
+  fill(5, 2, 3, 4, /*shear=*/1, /*baseline=*/5);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "........",
+                                           "........",
+                                           "........",
+                                           ".......#",
+                                           "......##",
+                                           ".....###",
+                                       }));
+}
+
+TEST_F(FillMaskTest, PageCoordinatesFromOrigin) {
+  framebuffer_.setOrigin(100, 50);
+  fill(98, 54, 3, 3);
+  EXPECT_EQ(drawnPixels(framebuffer_), std::vector<std::string>({
+                                           "........",
+                                           "........",
+                                           "........",
+                                           "........",
+                                           "#.......",
+                                           "#.......",
+                                       }));
+}
+
+TEST_F(FillMaskTest, BlendsPartialCoverage) {
+  Mask mask(1, 1, 128);
+  framebuffer_.fillMask(0, 0, mask.get(), 1, 1, Mask::kStride,
+                        sf::Color::White);
+  sf::Image image;
+  framebuffer_.copyToImage(&image);
+  EXPECT_EQ(image.getPixelsPtr()[0], 128);
+}
+
+}  // namespace
+}  // namespace raster
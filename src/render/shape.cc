@@ -1,59 +1,118 @@
 #include "shape.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
-sf::ConvexShape RoundedRectangle(float x, float y, float rectWidth,
-                                 float rectHeight, float radius,
-                                 int points = 10) {
-  sf::ConvexShape rrect;
-  rrect.setPointCount(points * 4);
+namespace {
+
+// Returns the outline of a rounded rectangle, clockwise from the top right
+// corner, with `points` points per corner.
+std::vector<sf::Vector2f> RoundedRectangle(float x, float y, float rectWidth,
+                                           float rectHeight, float radius,
+                                           int points = 10) {
+  std::vector<sf::Vector2f> outline(points * 4);
   float X = 0, Y = 0;
   for (int i = 0; i < points; i++) {
     X += radius / points;
     Y = sqrt(radius * radius - X * X);
     sf::Vector2f v(X + x + rectWidth - radius, y - Y + radius);
-    rrect.setPoint(i, v);
+    outline[i] = v;
   }
   Y = 0;
   for (int i = 0; i < points; i++) {
     Y += radius / points;
     X = sqrt(radius * radius - Y * Y);
-    rrect.setPoint(points + i, sf::Vector2f(x + rectWidth + X - radius,
-                                            y + rectHeight - radius + Y));
+    outline[points + i] =
+        sf::Vector2f(x + rectWidth + X - radius, y + rectHeight - radius + Y);
   }
   X = 0;
   for (int i = 0; i < points; i++) {
     X += radius / points;
     Y = sqrt(radius * radius - X * X);
-    rrect.setPoint(points * 2 + i,
-                   sf::Vector2f(x + radius - X, y + rectHeight - radius + Y));
+    outline[points * 2 + i] =
+        sf::Vector2f(x + radius - X, y + rectHeight - radius + Y);
   }
   Y = 0;
   for (int i = 0; i < points; i++) {
     Y += radius / points;
     X = sqrt(radius * radius - Y * Y);
-    rrect.setPoint(points * 3 + i,
-                   sf::Vector2f(x - X + radius, y + radius - Y));
+    outline[points * 3 + i] = sf::Vector2f(x - X + radius, y + radius - Y);
   }
-  return rrect;
+  return outline;
+}
+
+void appendTriangle(sf::VertexArray* vertices, sf::Vector2f a, sf::Vector2f b,
+                    sf::Vector2f c, sf::Color color) {
+  vertices->append(sf::Vertex(a, color));
+  vertices->append(sf::Vertex(b, color));
+  vertices->append(sf::Vertex(c, color));
+}
+
+// Corners are drawn with a 10px radius, shrunk for boxes too small for it so
+// the shape stays inside its rect.
+float cornerRadius(float width, float height) {
+  return std::min(10.f, std::min(width, height) / 2);
 }
 
+}  // namespace
+
 namespace shape_render {
 
-void drawRect(sf::RenderWindow* window, int x0, int y0, int x1, int y1,
-              sf::Color c, int borderRadius) {
+void ShapeBatch::addRect(int x0, int y0, int x1, int y1, sf::Color c,
+                         int borderRadius) {
   float width = x1 - x0;
   float height = y1 - y0;
+  // Shapes are drawn opaque.
+  sf::Color color(c.r, c.g, c.b);
   if (borderRadius > 0) {
-    sf::ConvexShape shape = RoundedRectangle(x0, y0, width, height, 10);
-    shape.setFillColor(sf::Color(c.r, c.g, c.b));
-    window->draw(shape);
+    // The outline is convex, so it can be split into a fan of triangles
+    // around its center, as sf::ConvexShape does.
+    float radius = cornerRadius(width, height);
+    std::vector<sf::Vector2f> outline =
+        RoundedRectangle(x0, y0, width, height, radius);
+    sf::Vector2f center(x0 + width / 2, y0 + height / 2);
+    for (std::size_t i = 0; i < outline.size(); i++) {
+      appendTriangle(&vertices_, center, outline[i],
+                     outline[(i + 1) % outline.size()], color);
+    }
   } else {
-    sf::RectangleShape rectangle;
-    rectangle.setSize(sf::Vector2f(width, height));
-    rectangle.setFillColor(sf::Color(c.r, c.g, c.b));
-    rectangle.setPosition(x0, y0);
-    window->draw(rectangle);
+    sf::Vector2f topLeft(x0, y0);
+    sf::Vector2f topRight(x1, y0);
+    sf::Vector2f bottomRight(x1, y1);
+    sf::Vector2f bottomLeft(x0, y1);
+    appendTriangle(&vertices_, topLeft, topRight, bottomRight, color);
+    appendTriangle(&vertices_, topLeft, bottomRight, bottomLeft, color);
+  }
+}
+
+void ShapeBatch::draw(sf::RenderTarget* target) {
+  if (empty()) {
+    return;
+  }
+  target->draw(vertices_);
+  vertices_.clear();
+}
+
+void drawRect(raster::Framebuffer* framebuffer, int x0, int y0, int x1, int y1,
+              sf::Color c, int borderRadius) {
+  sf::Color color(c.r, c.g, c.b);
+  if (borderRadius <= 0 || x0 >= x1 || y0 >= y1) {
+    framebuffer->fillRect(x0, y0, x1, y1, color);
+    return;
+  }
+  float radius = cornerRadius(x1 - x0, y1 - y0);
+  // Only the rows crossing the corners are narrower than the rect.
+  int corner_rows = std::ceil(radius);
+  framebuffer->fillRect(x0, y0 + corner_rows, x1, y1 - corner_rows, color);
+  for (int i = 0; i < corner_rows; i++) {
+    // How far the center of the row is from the corners' centers.
+    float dy = radius - (i + 0.5f);
+    int inset = std::lround(
+        radius - std::sqrt(std::max(0.f, radius * radius - dy * dy)));
+    framebuffer->fillSpan(y0 + i, x0 + inset, x1 - inset, color);
+    framebuffer->fillSpan(y1 - 1 - i, x0 + inset, x1 - inset, color);
   }
 }
+
 }  // namespace shape_render
@@ -4,10 +4,31 @@
 #include "SFML/Graphics.hpp"
 #include "SFML/Window.hpp"
 
+#include "raster.h"
+
 namespace shape_render {
 
-void drawRect(sf::RenderWindow* window, int x0, int y0, int x1, int y1,
+// Collects filled rects and rounded rects as triangles in one vertex array,
+// so any number of them can be drawn with a single draw call. Shapes are
+// drawn in the order they were added.
+class ShapeBatch {
+  sf::VertexArray vertices_;
+
+ public:
+  ShapeBatch() : vertices_(sf::Triangles){};
+  void addRect(int x0, int y0, int x1, int y1, sf::Color c,
+               int borderRadius = 0);
+  bool empty() const { return vertices_.getVertexCount() == 0; }
+  // Draws everything added since the last draw, then empties the batch.
+  void draw(sf::RenderTarget* target);
+};
+
+// Fills a rect or rounded rect in a software framebuffer, shaped as
+// ShapeBatch::addRect() shapes it. Rounded corners are filled a row at a
+// time.
+void drawRect(raster::Framebuffer* framebuffer, int x0, int y0, int x1, int y1,
               sf::Color c, int borderRadius = 0);
-}
+
+}  // namespace shape_render
 
 #endif
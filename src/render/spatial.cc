@@ -0,0 +1,93 @@
+// Uniform grid index for finding the paint ops in an area of the page.
+
+#include "spatial.h"
+
+#include <algorithm>
+
+namespace spatial {
+
+bool intersects(const layout::Rect &a, const layout::Rect &b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+         b.y < a.y + a.height;
+}
+
+bool contains(const layout::Rect &rect, int x, int y) {
+  return x >= rect.x && x < rect.x + rect.width && y >= rect.y &&
+         y < rect.y + rect.height;
+}
+
+void GridIndex::build(std::vector<layout::Rect> rects, int cell_size) {
+  rects_ = std::move(rects);
+  cell_size_ = cell_size;
+  // The grid starts at the origin: nothing is drawn at negative coordinates.
+  int right = 0;
+  int bottom = 0;
+  for (const layout::Rect &rect : rects_) {
+    right = std::max(right, rect.x + rect.width);
+    bottom = std::max(bottom, rect.y + rect.height);
+  }
+  columns_ = right / cell_size_ + 1;
+  rows_ = bottom / cell_size_ + 1;
+  cells_.assign(columns_ * rows_, std::vector<int>());
+  for (int id = 0; id < rects_.size(); id++) {
+    int col0, row0, col1, row1;
+    if (!cellRange(rects_[id], &col0, &row0, &col1, &row1)) {
+      continue;
+    }
+    for (int row = row0; row <= row1; row++) {
+      for (int col = col0; col <= col1; col++) {
+        cells_[row * columns_ + col].push_back(id);
+      }
+    }
+  }
+}
+
+bool GridIndex::cellRange(const layout::Rect &rect, int *col0, int *row0,
+                          int *col1, int *row1) const {
+  if (rect.width <= 0 || rect.height <= 0 || rect.x + rect.width <= 0 ||
+      rect.y + rect.height <= 0) {
+    return false;
+  }
+  *col0 = std::max(0, rect.x) / cell_size_;
+  *row0 = std::max(0, rect.y) / cell_size_;
+  *col1 = std::min(columns_ - 1, (rect.x + rect.width - 1) / cell_size_);
+  *row1 = std::min(rows_ - 1, (rect.y + rect.height - 1) / cell_size_);
+  return *col0 <= *col1 && *row0 <= *row1;
+}
+
+void GridIndex::query(const layout::Rect &area, std::vector<int> *ids) const {
+  ids->clear();
+  int col0, row0, col1, row1;
+  if (!cellRange(area, &col0, &row0, &col1, &row1)) {
+    return;
+  }
+  for (int row = row0; row <= row1; row++) {
+    for (int col = col0; col <= col1; col++) {
+      for (int id : cells_[row * columns_ + col]) {
+        if (intersects(rects_[id], area)) {
+          ids->push_back(id);
+        }
+      }
+    }
+  }
+  // A rect spanning several cells is found once per cell.
+  std::sort(ids->begin(), ids->end());
+  ids->erase(std::unique(ids->begin(), ids->end()), ids->end());
+}
+
+int GridIndex::queryPoint(int x, int y) const {
+  if (x < 0 || y < 0 || x / cell_size_ >= columns_ ||
+      y / cell_size_ >= rows_) {
+    return -1;
+  }
+  const std::vector<int> &cell = cells_[(y / cell_size_) * columns_ +
+                                        x / cell_size_];
+  for (auto it = cell.rbegin(); it != cell.rend(); ++it) {
+    if (contains(rects_[*it], x, y)) {
+      return *it;
+    }
+  }
+  return -1;
+}
+
+}  // namespace spatial
@@ -0,0 +1,45 @@
+// Uniform grid index for finding the paint ops in an area of the page.
+
+#ifndef SPATIAL_H
+#define SPATIAL_H
+
+#include <vector>
+
+#include "../layout.h"
+
+namespace spatial {
+
+// Buckets rects into square cells of a uniform grid. A rect is listed in
+// every cell it overlaps, so a query only looks at the cells its area
+// covers. Pages are laid out in a narrow, tall column, which a grid indexes
+// about as well as a tree would, with less work to build.
+class GridIndex {
+  int cell_size_ = 256;
+  int columns_ = 0;
+  int rows_ = 0;
+  std::vector<layout::Rect> rects_;
+  // Ids of the rects overlapping each cell, in increasing order.
+  std::vector<std::vector<int>> cells_;
+
+  // Returns the range of cells covering `rect`, clamped to the grid. Returns
+  // false if it misses the grid.
+  bool cellRange(const layout::Rect &rect, int *col0, int *row0, int *col1,
+                 int *row1) const;
+
+ public:
+  // Indexes `rects`, identifying each by its position in the vector.
+  void build(std::vector<layout::Rect> rects, int cell_size = 256);
+  // Replaces `ids` with the ids of rects intersecting `area`, in increasing
+  // order.
+  void query(const layout::Rect &area, std::vector<int> *ids) const;
+  // Returns the largest id of a rect containing the point, or -1 if none.
+  int queryPoint(int x, int y) const;
+  std::size_t get_size() const { return rects_.size(); }
+};
+
+bool intersects(const layout::Rect &a, const layout::Rect &b);
+bool contains(const layout::Rect &rect, int x, int y);
+
+}  // namespace spatial
+
+#endif
@@ -1,81 +1,109 @@
 #include "text.h"
 
+#include <dirent.h>
+
+#include <cmath>
 #include <iostream>
 
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_split.h"
+
 #include "../color.h"
 #include "../constants.h"
+#include "../trace.h"
 #include "../util.h"
+#include "font_metrics.h"
+#include "glyph_atlas.h"
 
 namespace text_render {
 
 namespace {
 
-const std::string DEFAULT_FONT = "14";
-const std::string DEFAULT_TEXT_COLOR = "#000000";
-const std::string DEFAULT_STYLE = "normal";
 const float DEFAULT_LINE_HEIGHT = 1.2;
 
-std::unique_ptr<sf::Font> loadFont(const std::string &fontName) {
+const char* const DEFAULT_FONT = "Arial";
+
+const char* const FONT_EXTENSION = ".ttf";
+
+// Generic families, and the font that stands in for each.
+const std::pair<const char*, const char*> GENERIC_FAMILIES[] = {
+    {"sans-serif", "Arial"},
+};
+
+std::string fontPath(const std::string &fontName) {
+  return "fonts/" + fontName + FONT_EXTENSION;
+}
+
+std::unique_ptr<sf::Font> loadFont(const std::string &path) {
+  TRACE_SPAN("loadFont");
   std::unique_ptr<sf::Font> font(new sf::Font);
-  if (!font->loadFromFile("fonts/" + fontName + ".ttf")) {
-    logger::error("Unable to load font: " + fontName);
+  if (!font->loadFromFile(path)) {
+    logger::error("Unable to load font: " + path);
   }
   return font;
 }
 
 sf::Color getTextColor(layout::LayoutElement *element) {
-  std::string c = element->getStyleValue(constants::css_properties::COLOR,
-                                         DEFAULT_TEXT_COLOR);
-  sf::Color color = color::parseColor(c);
-  return color;
+  return color::unpack(element->get_style().color, sf::Color::Black);
 }
 
 int getSize(layout::LayoutElement *element) {
-  return std::stoi(element->getStyleValue(constants::css_properties::FONT_SIZE,
-                                          DEFAULT_FONT));
+  return element->get_style().font_size;
 }
 
 sf::Uint32 getStyle(layout::LayoutElement *element) {
-  std::string style = element->getStyleValue(
-      constants::css_properties::FONT_STYLE, DEFAULT_STYLE);
-  std::string weight = element->getStyleValue(
-      constants::css_properties::FONT_WEIGHT, DEFAULT_STYLE);
-  std::string decoration = element->getStyleValue(
-      constants::css_properties::TEXT_DECORATION, DEFAULT_STYLE);
+  const style::ComputedStyle &style = element->get_style();
   sf::Uint32 textStyle = sf::Text::Regular;
-  if (weight == constants::css_font_values::BOLD) {
+  if (style.bold) {
     textStyle = textStyle | sf::Text::Bold;
   }
-  if (style == constants::css_font_values::ITALIC) {
+  if (style.italic) {
     textStyle = textStyle | sf::Text::Italic;
   }
-  if (decoration == constants::css_font_values::UNDERLINE) {
+  if (style.underline) {
     textStyle = textStyle | sf::Text::Underlined;
   }
   return textStyle;
 }
 }  // namespace
 
-int getTextWidth(layout::LayoutElement *element) {
-  sf::FloatRect rect = element->get_text_node().getGlobalBounds();
+TextMeasurer::TextMeasurer(layout::LayoutElement *element)
+    : element_(element) {
+  const style::ComputedStyle &style = element->get_style();
+  FontRegistry *registry = FontRegistry::getInstance();
+  metrics_ =
+      registry->getMetrics(registry->resolveFamily(style.font_family),
+                           getSize(element), style.bold, style.italic);
+}
+
+int TextMeasurer::getWidth(absl::string_view text) const {
+  if (metrics_ != nullptr && FontMetrics::isMeasurable(text)) {
+    return metrics_->measure(text);
+  }
+  // Text the tables don't cover is laid out by SFML.
+  std::unique_ptr<sf::Text> sf_text =
+      constructText(element_, std::string(text));
+  sf::FloatRect rect = sf_text->getGlobalBounds();
   return rect.width + rect.left;
 }
 
 int getTextHeight(layout::LayoutElement *element) {
   int fontSize = getSize(element);
-  std::string lineHeight =
-      element->getStyleValue(constants::css_properties::LINE_HEIGHT);
-  if (lineHeight == constants::DEFAULT) {
+  int lineHeight = element->get_style().line_height;
+  if (lineHeight == -1) {
     return fontSize * DEFAULT_LINE_HEIGHT;
   } else {
-    return std::stoi(lineHeight);
+    return lineHeight;
   }
 }
 
 std::unique_ptr<sf::Text> constructText(layout::LayoutElement *element,
                                         const std::string &rawText) {
   std::unique_ptr<sf::Text> text(new sf::Text);
-  text->setFont(FontRegistry::getInstance()->load("Arial"));
+  FontRegistry *registry = FontRegistry::getInstance();
+  text->setFont(registry->load(
+      registry->resolveFamily(element->get_style().font_family)));
   text->setString(rawText);
   text->setCharacterSize(getSize(element));
   text->setFillColor(getTextColor(element));
@@ -83,24 +111,372 @@ std::unique_ptr<sf::Text> constructText(layout::LayoutElement *element,
   return text;
 }
 
-// Global static pointer to font registry
-FontRegistry *FontRegistry::instance_ = nullptr;
+void drawText(raster::Framebuffer *framebuffer, const sf::Text &text) {
+  raster::GlyphAtlas *atlas = raster::GlyphAtlas::getInstance();
+  int face = atlas->loadFace(
+      FontRegistry::getInstance()->getPath(*text.getFont()));
+  if (face == -1) {
+    return;
+  }
+  unsigned size = text.getCharacterSize();
+  sf::Uint32 style = text.getStyle();
+  bool bold = style & sf::Text::Bold;
+  float shear = (style & sf::Text::Italic) ? ITALIC_SHEAR : 0;
+  sf::Color color = text.getFillColor();
+  sf::Vector2f position = text.getPosition();
+  // sf::Text puts the baseline one character size below its position.
+  int baseline = std::lround(position.y + size);
+  float space = atlas->getGlyph(face, size, bold, ' ').advance;
+  float x = 0;
+  sf::Uint32 prev = 0;
+  const sf::String &string = text.getString();
+  for (std::size_t i = 0; i < string.getSize(); i++) {
+    sf::Uint32 c = string[i];
+    x += atlas->getKerning(face, size, prev, c);
+    prev = c;
+    if (c == ' ') {
+      x += space;
+      continue;
+    } else if (c == '\t') {
+      x += space * 4;
+      continue;
+    }
+    const raster::Glyph &glyph = atlas->getGlyph(face, size, bold, c);
+    framebuffer->fillMask(std::lround(position.x + x) + glyph.left,
+                          baseline + glyph.top, glyph.pixels,
+                          glyph.width, glyph.height,
+                          raster::GlyphAtlas::kWidth, color, shear, baseline);
+    x += glyph.advance;
+  }
+  if (style & sf::Text::Underlined) {
+    float offset = atlas->getUnderlinePosition(face, size);
+    float thickness = atlas->getUnderlineThickness(face, size);
+    int top = std::floor(baseline + offset - thickness / 2 + 0.5f);
+    int bottom = top + std::floor(thickness + 0.5f);
+    framebuffer->fillRect(std::lround(position.x), top,
+                          std::lround(position.x + x), bottom, color);
+  }
+}
+
+namespace {
+
+// Appends two triangles covering a quad whose top and bottom edges are
+// `shear` times their height slanted, textured from `uv`.
+void appendQuad(std::vector<sf::Vertex> *vertices, sf::Vector2f origin,
+                float left, float top, float right, float bottom, float shear,
+                sf::Color color, const sf::FloatRect &uv) {
+  float u1 = uv.left;
+  float v1 = uv.top;
+  float u2 = uv.left + uv.width;
+  float v2 = uv.top + uv.height;
+  sf::Vertex top_left(
+      sf::Vector2f(origin.x + left - shear * top, origin.y + top), color,
+      sf::Vector2f(u1, v1));
+  sf::Vertex top_right(
+      sf::Vector2f(origin.x + right - shear * top, origin.y + top), color,
+      sf::Vector2f(u2, v1));
+  sf::Vertex bottom_left(
+      sf::Vector2f(origin.x + left - shear * bottom, origin.y + bottom),
+      color, sf::Vector2f(u1, v2));
+  sf::Vertex bottom_right(
+      sf::Vector2f(origin.x + right - shear * bottom, origin.y + bottom),
+      color, sf::Vector2f(u2, v2));
+  vertices->push_back(top_left);
+  vertices->push_back(top_right);
+  vertices->push_back(bottom_left);
+  vertices->push_back(bottom_left);
+  vertices->push_back(top_right);
+  vertices->push_back(bottom_right);
+}
+
+// Appends an underline or strike-through from the start of the line to `x`.
+// Lines are textured from the white pixels SFML keeps at the corner of every
+// glyph page.
+void appendLine(std::vector<sf::Vertex> *vertices, sf::Vector2f origin,
+                float x, float y, float offset, float thickness,
+                sf::Color color) {
+  float top = std::floor(y + offset - thickness / 2 + 0.5f);
+  float bottom = top + std::floor(thickness + 0.5f);
+  appendQuad(vertices, origin, 0, top, x, bottom, 0, color,
+             sf::FloatRect(1, 1, 0, 0));
+}
+
+}  // namespace
+
+void buildGlyphRun(const sf::Text &text, GlyphRun *run) {
+  run->vertices.clear();
+  const sf::Font *font = text.getFont();
+  if (font == nullptr) {
+    run->texture = nullptr;
+    return;
+  }
+  unsigned size = text.getCharacterSize();
+  run->texture = &font->getTexture(size);
+  sf::Uint32 style = text.getStyle();
+  bool bold = style & sf::Text::Bold;
+  bool underlined = style & sf::Text::Underlined;
+  bool struck = style & sf::Text::StrikeThrough;
+  float shear = (style & sf::Text::Italic) ? ITALIC_SHEAR : 0;
+  float underline_offset = font->getUnderlinePosition(size);
+  float line_thickness = font->getUnderlineThickness(size);
+  sf::FloatRect x_bounds = font->getGlyph('x', size, bold).bounds;
+  float strike_offset = x_bounds.top + x_bounds.height / 2;
+  float space = font->getGlyph(' ', size, bold).advance;
+  float line_spacing = font->getLineSpacing(size);
+  sf::Color color = text.getFillColor();
+  sf::Vector2f origin = text.getPosition();
+  const sf::String &string = text.getString();
+  run->vertices.reserve(string.getSize() * 6);
+  // The pen starts on the baseline, one character size down.
+  float x = 0;
+  float y = size;
+  sf::Uint32 prev = 0;
+  for (std::size_t i = 0; i < string.getSize(); i++) {
+    sf::Uint32 c = string[i];
+    x += font->getKerning(prev, c, size);
+    if (c == '\n' && prev != '\n') {
+      if (underlined) {
+        appendLine(&run->vertices, origin, x, y, underline_offset,
+                   line_thickness, color);
+      }
+      if (struck) {
+        appendLine(&run->vertices, origin, x, y, strike_offset,
+                   line_thickness, color);
+      }
+    }
+    prev = c;
+    if (c == ' ') {
+      x += space;
+      continue;
+    } else if (c == '\t') {
+      x += space * 4;
+      continue;
+    } else if (c == '\n') {
+      y += line_spacing;
+      x = 0;
+      continue;
+    }
+    // sf::Text pads each quad by a pixel so filtering doesn't cut off the
+    // glyph's edges.
+    const sf::Glyph &glyph = font->getGlyph(c, size, bold);
+    const float padding = 1;
+    const sf::FloatRect &bounds = glyph.bounds;
+    sf::FloatRect uv(glyph.textureRect.left - padding,
+                     glyph.textureRect.top - padding,
+                     glyph.textureRect.width + 2 * padding,
+                     glyph.textureRect.height + 2 * padding);
+    appendQuad(&run->vertices, sf::Vector2f(origin.x + x, origin.y + y),
+               bounds.left - padding, bounds.top - padding,
+               bounds.left + bounds.width + padding,
+               bounds.top + bounds.height + padding, shear, color, uv);
+    x += glyph.advance;
+  }
+  if (underlined && x > 0) {
+    appendLine(&run->vertices, origin, x, y, underline_offset, line_thickness,
+               color);
+  }
+  if (struck && x > 0) {
+    appendLine(&run->vertices, origin, x, y, strike_offset, line_thickness,
+               color);
+  }
+}
+
+void TextBatch::add(const GlyphRun &run) {
+  if (run.vertices.empty()) {
+    return;
+  }
+  for (GlyphRun &page : pages_) {
+    if (page.texture == run.texture) {
+      page.vertices.insert(page.vertices.end(), run.vertices.begin(),
+                           run.vertices.end());
+      return;
+    }
+  }
+  pages_.push_back(run);
+}
+
+bool TextBatch::empty() const {
+  for (const GlyphRun &page : pages_) {
+    if (!page.vertices.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int TextBatch::draw(sf::RenderTarget *target) {
+  int draw_calls = 0;
+  for (GlyphRun &page : pages_) {
+    if (page.vertices.empty()) {
+      continue;
+    }
+    target->draw(page.vertices.data(), page.vertices.size(), sf::Triangles,
+                 sf::RenderStates(page.texture));
+    page.vertices.clear();
+    draw_calls++;
+  }
+  return draw_calls;
+}
+
+void FontRegistry::preload(const std::string &directory) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    logger::error("Unable to open font directory: " + directory);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (dirent *file = readdir(dir)) {
+    absl::string_view name = file->d_name;
+    if (!absl::ConsumeSuffix(&name, FONT_EXTENSION) ||
+        fonts_.count(std::string(name)) > 0) {
+      continue;
+    }
+    Entry *entry = new Entry;
+    entry->path = directory + "/" + file->d_name;
+    fonts_[std::string(name)].reset(entry);
+    loaders_.emplace_back([this, entry]() {
+      trace::setThreadName("font loader");
+      loadEntry(entry);
+    });
+  }
+  closedir(dir);
+}
+
+void FontRegistry::loadEntry(Entry *entry) {
+  std::unique_ptr<sf::Font> font = loadFont(entry->path);
+  // The glyph atlas reads the file separately, for metrics and software
+  // rendering.
+  int face = raster::GlyphAtlas::getInstance()->loadFace(entry->path);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->font = std::move(font);
+    entry->face = face;
+    entry->loaded = true;
+  }
+  loaded_.notify_all();
+}
+
+const FontRegistry::Entry &FontRegistry::getEntry(
+    const std::string &fontName) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = fonts_.find(fontName);
+  if (it == fonts_.end()) {
+    Entry *entry = new Entry;
+    entry->path = fontPath(fontName);
+    fonts_[fontName].reset(entry);
+    lock.unlock();
+    loadEntry(entry);
+    return *entry;
+  }
+  const Entry *entry = it->second.get();
+  loaded_.wait(lock, [entry]() { return entry->loaded; });
+  return *entry;
+}
 
 const sf::Font &FontRegistry::load(const std::string &fontName) {
-  if (fonts_.find(fontName) == fonts_.end()) {
-    fonts_[fontName] = loadFont(fontName);
+  return *getEntry(fontName).font;
+}
+
+const std::string &FontRegistry::resolveFamily(const std::string &families) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = families_.find(families);
+    if (it != families_.end()) {
+      return it->second;
+    }
   }
-  return *fonts_[fontName];
+  std::string resolved = DEFAULT_FONT;
+  for (absl::string_view family : absl::StrSplit(families, ',')) {
+    family = absl::StripAsciiWhitespace(family);
+    family = absl::StripPrefix(absl::StripSuffix(family, "\""), "\"");
+    family = absl::StripPrefix(absl::StripSuffix(family, "'"), "'");
+    for (const auto &generic : GENERIC_FAMILIES) {
+      if (absl::EqualsIgnoreCase(family, generic.first)) {
+        family = generic.second;
+      }
+    }
+    // Family names are case-insensitive. Only fonts in the registry are
+    // considered, so an unknown family costs no file system lookups.
+    std::string name;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto &font : fonts_) {
+        if (absl::EqualsIgnoreCase(family, font.first)) {
+          name = font.first;
+        }
+      }
+    }
+    if (!name.empty() && getEntry(name).face != -1) {
+      resolved = name;
+      break;
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return families_.emplace(families, resolved).first->second;
 }
 
-FontRegistry *FontRegistry::getInstance() {
-  if (instance_ == nullptr) {
-    instance_ = new FontRegistry;
+const FontMetrics *FontRegistry::getMetrics(const std::string &fontName,
+                                            unsigned size, bool bold,
+                                            bool italic) {
+  auto key = std::make_tuple(fontName, size, bold, italic);
+  MetricsEntry *entry;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = metrics_.find(key);
+    if (it != metrics_.end()) {
+      entry = it->second.get();
+      loaded_.wait(lock, [entry]() { return entry->built; });
+      return entry->metrics.get();
+    }
+    entry = new MetricsEntry;
+    metrics_[key].reset(entry);
   }
-  return instance_;
+  // Building the tables rasterizes every glyph, so it isn't done under the
+  // lock, which would hold up other fonts and sizes.
+  int face = getEntry(fontName).face;
+  std::unique_ptr<FontMetrics> metrics;
+  if (face != -1) {
+    metrics.reset(new FontMetrics(face, size, bold, italic));
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry->metrics = std::move(metrics);
+    entry->built = true;
+  }
+  loaded_.notify_all();
+  return entry->metrics.get();
 }
+
+std::string FontRegistry::getPath(const sf::Font &font) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto &entry : fonts_) {
+    if (entry.second->font.get() == &font) {
+      return entry.second->path;
+    }
+  }
+  return "";
+}
+
+FontRegistry *FontRegistry::getInstance() {
+  // Created once, even if several threads ask for it first at once.
+  static FontRegistry *instance = new FontRegistry;
+  return instance;
+}
+
 void FontRegistry::clear() {
   logger::info("Clearing font registry");
+  std::vector<std::thread> loaders;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    loaders.swap(loaders_);
+  }
+  // Loaders need the lock to finish.
+  for (std::thread &loader : loaders) {
+    loader.join();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
   fonts_.clear();
+  families_.clear();
+  metrics_.clear();
 }
 }  // namespace text_render
@@ -1,19 +1,56 @@
 #ifndef TEXT_H
 #define TEXT_H
 
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include "absl/strings/string_view.h"
 
 #include "SFML/Graphics.hpp"
 #include "SFML/Window.hpp"
 
 #include "../layout.h"
+#include "font_metrics.h"
+#include "raster.h"
 
 namespace text_render {
 
-// Registry singleton for SFML fonts
+// Registry singleton for fonts. preload() loads every font in fonts/ on
+// background threads while the page is parsed, so layout finds them ready;
+// a font that is still loading is waited for. Every method may be called
+// from any thread, but SFML only lets one thread at a time use an sf::Font.
 class FontRegistry {
-  std::map<std::string, std::unique_ptr<sf::Font>> fonts_;
-  static FontRegistry* instance_;
+  struct Entry {
+    std::string path;
+    std::unique_ptr<sf::Font> font;
+    // The font's face in the glyph atlas, or -1 if it couldn't be loaded.
+    int face = -1;
+    bool loaded = false;
+  };
+  struct MetricsEntry {
+    // Null if the font couldn't be loaded.
+    std::unique_ptr<FontMetrics> metrics;
+    bool built = false;
+  };
+  // Guards everything below.
+  mutable std::mutex mutex_;
+  // Notified whenever a font finishes loading or metrics finish building.
+  std::condition_variable loaded_;
+  // Keyed by font name, the font's file name without ".ttf".
+  std::map<std::string, std::unique_ptr<Entry>> fonts_;
+  std::vector<std::thread> loaders_;
+  // The font each font-family list resolved to.
+  std::map<std::string, std::string> families_;
+  // Keyed by font name, size, bold and italic. Metrics are built by the
+  // first thread to ask for them, outside the lock, and other threads asking
+  // for the same ones wait.
+  std::map<std::tuple<std::string, unsigned, bool, bool>,
+           std::unique_ptr<MetricsEntry>>
+      metrics_;
   // Make default constuctor private so it can't be called
   FontRegistry() {}
 
@@ -21,16 +58,76 @@ class FontRegistry {
   FontRegistry(const FontRegistry&) = delete;
   FontRegistry& operator=(const FontRegistry&) = delete;
 
+  // Returns a loaded font, waiting for it if another thread is loading it
+  // and loading it on this thread if nothing has started to.
+  const Entry& getEntry(const std::string& fontName);
+  void loadEntry(Entry* entry);
+
  public:
+  // Starts loading each font in `directory`, each on its own thread.
+  void preload(const std::string& directory = "fonts");
   const sf::Font& load(const std::string& fontName);
+  // Returns the name of the first font of a CSS font-family list that is in
+  // the registry, or of the default font if none is. The reference stays
+  // valid until clear().
+  const std::string& resolveFamily(const std::string& families);
+  // Returns the file a font in the registry was loaded from, or an empty
+  // string if it isn't in the registry.
+  std::string getPath(const sf::Font& font) const;
+  // Returns the metrics of a font at a size and style, building them the
+  // first time, or null if the font can't be loaded.
+  const FontMetrics* getMetrics(const std::string& fontName, unsigned size,
+                                bool bold, bool italic);
   static FontRegistry* getInstance();
+  // Waits for fonts that are still loading, then frees every font.
   void clear();
 };
 
 int getTextHeight(layout::LayoutElement* element);
-int getTextWidth(layout::LayoutElement* element);
+
+// Measures text in an element's font, which is looked up once for all the
+// words of a run.
+class TextMeasurer {
+  layout::LayoutElement* element_;
+  const FontMetrics* metrics_;
+
+ public:
+  explicit TextMeasurer(layout::LayoutElement* element);
+  // Returns the width of `text`, from its origin to the right edge of its
+  // last glyph, as sf::Text would lay it out.
+  int getWidth(absl::string_view text) const;
+};
 std::unique_ptr<sf::Text> constructText(layout::LayoutElement* element,
                                         const std::string& rawText);
+// Draws a single line of text into a software framebuffer, placing each glyph
+// where sf::Text would.
+void drawText(raster::Framebuffer* framebuffer, const sf::Text& text);
+
+// The triangles sf::Text draws for a line, in page coordinates, textured from
+// the glyph page of its font at its character size.
+struct GlyphRun {
+  const sf::Texture* texture = nullptr;
+  std::vector<sf::Vertex> vertices;
+};
+// Replaces `run` with the glyphs and lines of `text` at its position, laid
+// out as sf::Text lays them out.
+void buildGlyphRun(const sf::Text& text, GlyphRun* run);
+
+// Collects glyph runs into one vertex array per glyph page, so any number of
+// lines in the same font and size are drawn with a single draw call. Runs on
+// a page are drawn in the order they were added.
+class TextBatch {
+  // A page is only used by one font and size, and a frame uses few of them,
+  // so they are searched in order.
+  std::vector<GlyphRun> pages_;
+
+ public:
+  void add(const GlyphRun& run);
+  bool empty() const;
+  // Draws everything added since the last draw, one draw call per page, then
+  // empties the batch. Returns the number of draw calls.
+  int draw(sf::RenderTarget* target);
+};
 }  // namespace text_render
 
 #endif
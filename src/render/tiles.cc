@@ -0,0 +1,92 @@
+// Rasterizes the page into cached tiles, so scrolling only composites them.
+
+#include "tiles.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "../trace.h"
+#include "../util.h"
+#include "spatial.h"
+
+namespace tiles {
+
+void TileCache::rasterize(const DisplayList &list, int col, int row,
+                          Tile *tile, bool batch_shapes, bool batch_text) {
+  TRACE_SPAN("rasterizeTile");
+  if (tile->texture == nullptr) {
+    tile->texture.reset(new sf::RenderTexture);
+    if (!tile->texture->create(tile_size_, tile_size_)) {
+      logger::error("Unable to create tile texture");
+    }
+  }
+  layout::Rect area;
+  area.x = col * tile_size_;
+  area.y = row * tile_size_;
+  area.width = tile_size_;
+  area.height = tile_size_;
+  // Draw in page coordinates, looking at the tile's area.
+  tile->texture->setView(
+      sf::View(sf::FloatRect(area.x, area.y, area.width, area.height)));
+  tile->texture->clear(sf::Color::Black);
+  list.replay(tile->texture.get(), area, batch_shapes, batch_text);
+  tile->texture->display();
+  stats_.tiles_rasterized++;
+}
+
+void TileCache::composite(const DisplayList &list, sf::RenderWindow *window,
+                          int scroll_y, bool batch_shapes, bool batch_text) {
+  stats_.frames++;
+  sf::Vector2u size = window->getSize();
+  int col1 = (static_cast<int>(size.x) - 1) / tile_size_;
+  int row0 = scroll_y / tile_size_;
+  int row1 = (scroll_y + static_cast<int>(size.y) - 1) / tile_size_;
+  for (int row = row0; row <= row1; row++) {
+    for (int col = 0; col <= col1; col++) {
+      Tile &tile = tiles_[std::make_pair(col, row)];
+      if (tile.texture == nullptr) {
+        rasterize(list, col, row, &tile, batch_shapes, batch_text);
+      }
+      tile.last_used = stats_.frames;
+      sf::Sprite sprite(tile.texture->getTexture());
+      sprite.setPosition(col * tile_size_, row * tile_size_ - scroll_y);
+      window->draw(sprite);
+      stats_.tiles_drawn++;
+    }
+  }
+  evict();
+}
+
+void TileCache::invalidate(const layout::Rect &area) {
+  for (auto it = tiles_.begin(); it != tiles_.end();) {
+    layout::Rect tile;
+    tile.x = it->first.first * tile_size_;
+    tile.y = it->first.second * tile_size_;
+    tile.width = tile_size_;
+    tile.height = tile_size_;
+    if (spatial::intersects(tile, area)) {
+      it = tiles_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void TileCache::evict() {
+  if (tiles_.size() <= max_tiles_) {
+    return;
+  }
+  std::vector<std::pair<long, std::pair<int, int>>> by_age;
+  for (const auto &tile : tiles_) {
+    by_age.emplace_back(tile.second.last_used, tile.first);
+  }
+  std::sort(by_age.begin(), by_age.end());
+  for (std::size_t i = 0;
+       i < by_age.size() - max_tiles_ && by_age[i].first < stats_.frames;
+       i++) {
+    tiles_.erase(by_age[i].second);
+    stats_.tiles_evicted++;
+  }
+}
+
+}  // namespace tiles
@@ -0,0 +1,67 @@
+// Rasterizes the page into cached tiles, so scrolling only composites them.
+
+#ifndef TILES_H
+#define TILES_H
+
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "SFML/Graphics.hpp"
+
+#include "../layout.h"
+#include "paint.h"
+
+namespace tiles {
+
+// Counters describing how much rasterizing compositing needed.
+struct TileStats {
+  long frames = 0;
+  long tiles_drawn = 0;
+  long tiles_rasterized = 0;
+  long tiles_evicted = 0;
+};
+
+// A grid of fixed-size textures covering the page. Each tile is rasterized
+// from the display list the first time it is needed and kept until its area
+// is invalidated, so a frame that only scrolls draws a few textured quads.
+class TileCache {
+  struct Tile {
+    std::unique_ptr<sf::RenderTexture> texture;
+    // Frame the tile was last composited in.
+    long last_used = 0;
+  };
+  int tile_size_;
+  std::size_t max_tiles_;
+  // Tiles by column and row.
+  std::map<std::pair<int, int>, Tile> tiles_;
+  TileStats stats_;
+
+  // Draws the part of the page under `tile` into its texture.
+  void rasterize(const DisplayList& list, int col, int row, Tile* tile,
+                 bool batch_shapes, bool batch_text);
+  // Drops the least recently composited tiles until at most `max_tiles_`
+  // remain. Tiles composited in the current frame are kept even past the
+  // limit, since a window bigger than the limit needs them all again next
+  // frame.
+  void evict();
+
+ public:
+  explicit TileCache(int tile_size = 512, std::size_t max_tiles = 48)
+      : tile_size_(tile_size), max_tiles_(max_tiles){};
+  // Draws the part of the page starting `scroll_y` pixels down to
+  // `window`, rasterizing any tiles it needs that aren't cached.
+  void composite(const DisplayList& list, sf::RenderWindow* window,
+                 int scroll_y, bool batch_shapes = true,
+                 bool batch_text = true);
+  // Drops the tiles overlapping `area` of the page.
+  void invalidate(const layout::Rect& area);
+  // Drops every tile.
+  void clear() { tiles_.clear(); }
+  const TileStats& get_stats() const { return stats_; }
+  void resetStats() { stats_ = TileStats(); }
+};
+
+}  // namespace tiles
+
+#endif
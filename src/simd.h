@@ -0,0 +1,14 @@
+// Compile-time detection of the vector instructions the engine uses.
+
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is part of the x86-64 baseline, so where SIMD_SSE2 is defined SSE2
+// kernels need no runtime check or extra build flags. Anything wider, such as
+// AVX2, still has to be checked for at runtime.
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#endif
@@ -1,10 +1,14 @@
 #include "style.h"
 
+#include <cstdlib>
 #include <iostream>
+#include <unordered_map>
 
 #include "absl/strings/match.h"
 #include "absl/strings/str_split.h"
 
+#include "color.h"
+#include "trace.h"
 #include "util.h"
 
 const std::vector<std::string> INLINE_TAGS = {
@@ -43,10 +47,16 @@ std::string getDefaultDisplay(const std::string &tag_name) {
 namespace style {
 typedef std::pair<MatchedRule, bool> MaybeMatchedRule;
 
-DisplayType StyledNode::get_display_type() const {
-  std::string displayStr =
-      getValue(style_values_, constants::css_properties::DISPLAY,
-               getDefaultDisplay(get_tag()));
+namespace {
+MatchStats match_stats;
+}  // namespace
+
+const MatchStats &getMatchStats() { return match_stats; }
+
+void resetMatchStats() { match_stats = MatchStats(); }
+
+namespace {
+DisplayType parseDisplayType(const std::string &displayStr) {
   if (displayStr == constants::css_display_types::TEXT) {
     return Text;
   } else if (displayStr == constants::css_display_types::INLINE) {
@@ -66,11 +76,170 @@ DisplayType StyledNode::get_display_type() const {
   }
 }
 
+// Parses the leading integer of a (unit-stripped) length, the same way
+// std::stoi would, falling back to `default_px` for non-numeric values.
+int parsePixels(const std::string &value, int default_px) {
+  const char *start = value.c_str();
+  char *end;
+  long px = std::strtol(start, &end, 10);
+  return end == start ? default_px : px;
+}
+
+Length parseLength(const std::string &value) {
+  Length length;
+  if (value == "auto") {
+    length.is_auto = true;
+  } else {
+    length.px = parsePixels(value, 0);
+  }
+  return length;
+}
+
+uint32_t parsePackedColor(const std::string &value) {
+  return color::pack(color::parseColor(value));
+}
+}  // namespace
+
+PropertyId getPropertyId(const std::string &property) {
+  static const std::unordered_map<std::string, PropertyId> property_ids = {
+      {constants::css_properties::DISPLAY, PropertyId::Display},
+      {constants::css_properties::FONT_SIZE, PropertyId::FontSize},
+      {constants::css_properties::FONT_FAMILY, PropertyId::FontFamily},
+      {constants::css_properties::FONT_WEIGHT, PropertyId::FontWeight},
+      {constants::css_properties::FONT_STYLE, PropertyId::FontStyle},
+      {constants::css_properties::LINE_HEIGHT, PropertyId::LineHeight},
+      {constants::css_properties::TEXT_DECORATION,
+       PropertyId::TextDecoration},
+      {constants::css_properties::COLOR, PropertyId::Color},
+      {constants::css_properties::BACKGROUND_COLOR,
+       PropertyId::BackgroundColor},
+      {constants::css_properties::BORDER_COLOR, PropertyId::BorderColor},
+      {constants::css_properties::BORDER_RADIUS, PropertyId::BorderRadius},
+      {constants::css_properties::BORDER_TOP_WIDTH,
+       PropertyId::BorderTopWidth},
+      {constants::css_properties::BORDER_RIGHT_WIDTH,
+       PropertyId::BorderRightWidth},
+      {constants::css_properties::BORDER_BOTTOM_WIDTH,
+       PropertyId::BorderBottomWidth},
+      {constants::css_properties::BORDER_LEFT_WIDTH,
+       PropertyId::BorderLeftWidth},
+      {constants::css_properties::MARGIN_TOP, PropertyId::MarginTop},
+      {constants::css_properties::MARGIN_RIGHT, PropertyId::MarginRight},
+      {constants::css_properties::MARGIN_BOTTOM, PropertyId::MarginBottom},
+      {constants::css_properties::MARGIN_LEFT, PropertyId::MarginLeft},
+      {constants::css_properties::PADDING_TOP, PropertyId::PaddingTop},
+      {constants::css_properties::PADDING_RIGHT, PropertyId::PaddingRight},
+      {constants::css_properties::PADDING_BOTTOM, PropertyId::PaddingBottom},
+      {constants::css_properties::PADDING_LEFT, PropertyId::PaddingLeft},
+      {constants::css_properties::WIDTH, PropertyId::Width},
+      {constants::css_properties::HEIGHT, PropertyId::Height},
+  };
+  auto it = property_ids.find(property);
+  if (it == property_ids.end()) {
+    return PropertyId::Unknown;
+  }
+  return it->second;
+}
+
+ComputedStyle computeStyle(const PropertyMap &style_values,
+                           const std::string &tag) {
+  ComputedStyle style;
+  style.display = parseDisplayType(getDefaultDisplay(tag));
+  for (auto const &style_value : style_values) {
+    const std::string &value = style_value.second;
+    switch (getPropertyId(style_value.first)) {
+      case PropertyId::Display:
+        style.display = parseDisplayType(value);
+        break;
+      case PropertyId::FontSize:
+        style.font_size = parseLength(value).resolve(-1);
+        break;
+      case PropertyId::FontFamily:
+        style.font_family = value;
+        break;
+      case PropertyId::FontWeight:
+        style.bold = value == constants::css_font_values::BOLD;
+        break;
+      case PropertyId::FontStyle:
+        style.italic = value == constants::css_font_values::ITALIC;
+        break;
+      case PropertyId::LineHeight:
+        style.line_height = parseLength(value).resolve(-1);
+        break;
+      case PropertyId::TextDecoration:
+        style.underline = value == constants::css_font_values::UNDERLINE;
+        break;
+      case PropertyId::Color:
+        style.color = parsePackedColor(value);
+        break;
+      case PropertyId::BackgroundColor:
+        style.background_color = parsePackedColor(value);
+        break;
+      case PropertyId::BorderColor:
+        style.border_color = parsePackedColor(value);
+        break;
+      case PropertyId::BorderRadius:
+        style.border_radius = parseLength(value).resolve(-1);
+        break;
+      case PropertyId::BorderTopWidth:
+        style.border_width.top = parseLength(value);
+        break;
+      case PropertyId::BorderRightWidth:
+        style.border_width.right = parseLength(value);
+        break;
+      case PropertyId::BorderBottomWidth:
+        style.border_width.bottom = parseLength(value);
+        break;
+      case PropertyId::BorderLeftWidth:
+        style.border_width.left = parseLength(value);
+        break;
+      case PropertyId::MarginTop:
+        style.margin.top = parseLength(value);
+        break;
+      case PropertyId::MarginRight:
+        style.margin.right = parseLength(value);
+        break;
+      case PropertyId::MarginBottom:
+        style.margin.bottom = parseLength(value);
+        break;
+      case PropertyId::MarginLeft:
+        style.margin.left = parseLength(value);
+        break;
+      case PropertyId::PaddingTop:
+        style.padding.top = parseLength(value);
+        break;
+      case PropertyId::PaddingRight:
+        style.padding.right = parseLength(value);
+        break;
+      case PropertyId::PaddingBottom:
+        style.padding.bottom = parseLength(value);
+        break;
+      case PropertyId::PaddingLeft:
+        style.padding.left = parseLength(value);
+        break;
+      case PropertyId::Width:
+        style.width = parseLength(value);
+        break;
+      case PropertyId::Height:
+        style.height = parseLength(value);
+        break;
+      case PropertyId::Unknown:
+        break;
+    }
+  }
+  return style;
+}
+
+StyledNode::StyledNode(dom::Node &node, PropertyMap style_values)
+    : node_(node), style_values_(std::move(style_values)) {
+  style_ = computeStyle(style_values_, get_tag());
+}
+
 std::string StyledNode::get_tag() const {
   dom::Node &node = get_node();
   try {
     dom::ElementNode &castToElement = dynamic_cast<dom::ElementNode &>(node);
-    return castToElement.get_tag();
+    return std::string(castToElement.get_tag());
   } catch (const std::bad_cast &e) {
     return constants::html_tags::TEXT;
   }
@@ -81,7 +250,7 @@ void StyledNode::log() const {
   for (auto it = style_values_.cbegin(); it != style_values_.cend(); ++it) {
     log_str += "\t" + it->first + ": " + it->second + "\n";
   }
-  logger::info(log_str);
+  logger::debug(log_str);
 }
 
 // Return the specified style property.
@@ -98,7 +267,7 @@ std::string getValue(const PropertyMap style_values,
 }
 
 // Returns true of the node matches the specified selector.
-bool isMatch(dom::ElementNode *node, css::Selector selector) {
+bool isMatch(dom::ElementNode *node, const css::Selector &selector) {
   if (selector.get_tag() == "*") {
     return true;
   } else if (node->get_tag() == selector.get_tag()) {
@@ -106,8 +275,8 @@ bool isMatch(dom::ElementNode *node, css::Selector selector) {
   } else if (!node->get_id().empty() && (node->get_id() == selector.get_id())) {
     return true;
   } else {
-    std::vector<std::string> node_classes = node->get_classes();
-    for (auto s : selector.get_classes()) {
+    std::vector<absl::string_view> node_classes = node->get_classes();
+    for (auto const &s : selector.get_classes()) {
       if (std::find(node_classes.begin(), node_classes.end(), s) !=
           node_classes.end()) {
         return true;
@@ -118,24 +287,21 @@ bool isMatch(dom::ElementNode *node, css::Selector selector) {
 }
 
 // If `rule` matches `elem`, return a `MatchedRule`. Otherwise return `None`.
-MaybeMatchedRule matchingRule(dom::ElementNode *node, css::Rule rule) {
-  std::vector<css::Selector> selectors = rule.get_selectors();
+MaybeMatchedRule matchingRule(dom::ElementNode *node, const css::Rule &rule) {
   css::Specificity tup;
-  for (auto s : selectors) {
+  for (auto const &s : rule.get_selectors()) {
     if (isMatch(node, s)) {
       tup = s.getSpecificity();
-      MatchedRule result(tup, rule);
+      MatchedRule result(tup, &rule);
       return std::pair<MatchedRule, bool>(result, true);
     }
   }
-  MatchedRule result(tup, rule);
+  MatchedRule result(tup, &rule);
   return std::pair<MatchedRule, bool>(result, false);
 }
 
-bool compareRules(MatchedRule r1, MatchedRule r2) {
-  css::Specificity s1 = r1.first;
-  css::Specificity s2 = r2.first;
-  return s1 < s2;
+bool compareRules(const MatchedRule &r1, const MatchedRule &r2) {
+  return r1.first < r2.first;
 }
 
 std::string parseSizeValues(const std::string &key,
@@ -162,7 +328,7 @@ void parseBorderShorthand(PropertyMap &pm, const std::string &name,
                           const std::string &value) {}
 
 void fillPropertyMap(PropertyMap &pm, PropertyMap &parentStyles,
-                     css::Declaration declaration) {
+                     const css::Declaration &declaration) {
   std::string value = declaration.get_value();
   std::string name = declaration.get_name();
   if (name == constants::css_properties::BORDER) {
@@ -237,56 +403,116 @@ PropertyMap getElementStyleValues(
     // }
   }
 
-  // Find all matching rules
+  // Find all matching rules, probing only those the index says could apply.
   std::vector<MatchedRule> matching_rules;
-  std::vector<css::Rule> all_rules = css->get_rules();
-  for (auto rule : all_rules) {
-    MaybeMatchedRule m = matchingRule(node, rule);
+  const std::vector<css::Rule> &all_rules = css->get_rules();
+  std::vector<int> candidates;
+  css->get_index().getCandidates(node->get_tag(), node->get_id(),
+                                 node->get_classes(), &candidates);
+  for (int i : candidates) {
+    MaybeMatchedRule m = matchingRule(node, all_rules[i]);
     if (m.second) {
       matching_rules.push_back(m.first);
     }
   }
-  // Go through the rules from lowest to highest specificity.
-  std::sort(matching_rules.begin(), matching_rules.end(), compareRules);
-  for (auto match : matching_rules) {
-    css::Rule rule = match.second;
-    for (auto declaration : rule.get_declarations()) {
+  match_stats.elements++;
+  match_stats.rules_probed += candidates.size();
+  // Go through the rules from lowest to highest specificity. Candidates are in
+  // stylesheet order, so a stable sort lets later rules win ties.
+  std::stable_sort(matching_rules.begin(), matching_rules.end(), compareRules);
+  for (auto const &match : matching_rules) {
+    for (auto const &declaration : match.second->get_declarations()) {
       fillPropertyMap(styles, parent_styles, declaration);
     }
-    // delete match;
   }
   expandStyles(styles);
   return styles;
 }
 
+bool StyleSharingCache::find(const dom::ElementNode &node,
+                             const PropertyMap &parent_styles,
+                             PropertyMap *style_values, ComputedStyle *style) {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->tag == node.get_tag() && it->id == node.get_id() &&
+        it->classes == node.getAttr(constants::html_attributes::CLASS) &&
+        it->parent_styles == parent_styles) {
+      *style_values = it->style_values;
+      *style = it->style;
+      // Keep the entry at the front so long runs of siblings stay cached.
+      std::rotate(entries_.begin(), it, it + 1);
+      stats.hits++;
+      return true;
+    }
+  }
+  stats.misses++;
+  return false;
+}
+
+void StyleSharingCache::insert(const dom::ElementNode &node,
+                               const PropertyMap &parent_styles,
+                               const PropertyMap &style_values,
+                               const ComputedStyle &style) {
+  if (entries_.size() == kMaxEntries) {
+    entries_.pop_back();
+  }
+  Entry entry{std::string(node.get_tag()),
+              std::string(node.get_id()),
+              std::string(node.getAttr(constants::html_attributes::CLASS)),
+              parent_styles,
+              style_values,
+              style};
+  entries_.insert(entries_.begin(), std::move(entry));
+}
+
 // Construct a tree of StyledNodes from a DOM tree + StyleSheet
-std::unique_ptr<StyledNode> styleTree(
-    dom::Node &root, const std::unique_ptr<css::StyleSheet const> &css,
-    PropertyMap parentStyles) {
-  std::unique_ptr<StyledNode> s;
-  std::vector<std::unique_ptr<StyledNode>> children;
+StyledNode *styleTree(dom::Node &root,
+                      const std::unique_ptr<css::StyleSheet const> &css,
+                      PropertyMap parentStyles, arena::Arena *arena,
+                      StyleSharingCache *cache) {
+  TRACE_SPAN("styleTree");
+  StyledNode *s;
   PropertyMap styles;
   try {
     // Determine if this is an element node, and recursively apply styles
     dom::ElementNode &castToElement = dynamic_cast<dom::ElementNode &>(root);
     if (!castToElement.isDisplayable()) {
-      s.reset(new StyledNode(castToElement, styles, std::move(children)));
+      s = arena->make<StyledNode>(castToElement, styles);
 
     } else {
-      styles = getElementStyleValues(&castToElement, css, parentStyles);
-      for (auto nodeChild : castToElement.get_children()) {
-        std::unique_ptr<StyledNode> styledChild =
-            styleTree(nodeChild, css, styles);
-        children.push_back(std::move(styledChild));
+      ComputedStyle shared_style;
+      bool shared = cache != nullptr && cache->find(castToElement, parentStyles,
+                                                    &styles, &shared_style);
+      if (!shared) {
+        styles = getElementStyleValues(&castToElement, css, parentStyles);
+      } else if (cache->verifying() &&
+                 getElementStyleValues(&castToElement, css, parentStyles) !=
+                     styles) {
+        logger::error("Shared styles differ from matched styles for:" +
+                      castToElement.toLogStr());
+        cache->recordMismatch();
+      }
+      if (shared) {
+        s = arena->make<StyledNode>(castToElement, styles, shared_style);
+      } else {
+        s = arena->make<StyledNode>(castToElement, styles);
+        if (cache != nullptr) {
+          cache->insert(castToElement, parentStyles, styles, s->get_style());
+        }
+      }
+      for (dom::Node &nodeChild : castToElement.get_children()) {
+        s->appendChild(styleTree(nodeChild, css, styles, arena, cache));
       }
-      s.reset(new StyledNode(castToElement, styles, std::move(children)));
     }
   } catch (const std::bad_cast &e) {
     dom::TextNode &castToText = dynamic_cast<dom::TextNode &>(root);
     styles = getTextStyleValues(parentStyles);
-    s.reset(new StyledNode(castToText, styles, std::move(children)));
+    s = arena->make<StyledNode>(castToText, styles);
+  }
+  // Building the dump of every property is expensive, so skip it unless it
+  // will be written.
+  if (logger::isEnabled(logger::Level::Debug)) {
+    s->log();
   }
-  s->log();
   return s;
 }
 }  // namespace style
@@ -5,15 +5,19 @@
 #ifndef STYLE_H
 #define STYLE_H
 
+#include <cstdint>
+#include <string>
+
 #include "constants.h"
 #include "dom.h"
 #include "parse/css.h"
+#include "tree.h"
 
 namespace style {
 
 typedef std::map<std::string, std::string> PropertyMap;
 
-typedef std::pair<css::Specificity, css::Rule> MatchedRule;
+typedef std::pair<css::Specificity, const css::Rule *> MatchedRule;
 
 enum DisplayType {
   Text,
@@ -25,38 +29,161 @@ enum DisplayType {
   Invisible
 };
 
+// The properties that are resolved into typed ComputedStyle fields.
+enum class PropertyId {
+  Display,
+  FontSize,
+  FontFamily,
+  FontWeight,
+  FontStyle,
+  LineHeight,
+  TextDecoration,
+  Color,
+  BackgroundColor,
+  BorderColor,
+  BorderRadius,
+  BorderTopWidth,
+  BorderRightWidth,
+  BorderBottomWidth,
+  BorderLeftWidth,
+  MarginTop,
+  MarginRight,
+  MarginBottom,
+  MarginLeft,
+  PaddingTop,
+  PaddingRight,
+  PaddingBottom,
+  PaddingLeft,
+  Width,
+  Height,
+  Unknown
+};
+
+PropertyId getPropertyId(const std::string &property);
+
+// A length resolved to pixels during styling.
+struct Length {
+  int px = 0;
+  bool is_auto = false;
+  // Returns the length in pixels, or `auto_px` if the length is auto.
+  int resolve(int auto_px) const { return is_auto ? auto_px : px; }
+};
+
+struct EdgeLengths {
+  Length top;
+  Length right;
+  Length bottom;
+  Length left;
+};
+
+// Typed, pre-resolved styles used by layout and painting. Colors are packed
+// as 0xRRGGBBAA; a packed value of 0 means the color was not specified.
+struct ComputedStyle {
+  DisplayType display = Block;
+  Length width{0, true};
+  Length height{0, true};
+  EdgeLengths margin;
+  EdgeLengths padding;
+  EdgeLengths border_width;
+  int border_radius = 0;
+  int font_size = 14;
+  // The font-family list as written, resolved to a font by the font
+  // registry. Empty for the default font.
+  std::string font_family;
+  // Line height in pixels, or -1 to derive it from the font size.
+  int line_height = -1;
+  bool bold = false;
+  bool italic = false;
+  bool underline = false;
+  uint32_t color = 0;
+  uint32_t background_color = 0;
+  uint32_t border_color = 0;
+};
+
 // Represents a DOM node paired with the styles that apply to it.
-// Cascading of styles is applied
-class StyledNode {
+// Cascading of styles is applied. The property map is kept for inheritance
+// and debugging; everything downstream of styling reads the ComputedStyle.
+// StyledNodes are allocated in their document's arena.
+class StyledNode : public tree::TreeNode<StyledNode> {
   dom::Node &node_;
   PropertyMap style_values_;
-  std::vector<std::unique_ptr<StyledNode>> children_;
+  ComputedStyle style_;
 
  public:
-  StyledNode(dom::Node &node, PropertyMap style_values,
-             std::vector<std::unique_ptr<StyledNode>> children)
-      : node_(node),
-        style_values_(style_values),
-        children_(std::move(children)){};
+  StyledNode(dom::Node &node, PropertyMap style_values);
+  // Constructs a node whose styles have already been resolved.
+  StyledNode(dom::Node &node, PropertyMap style_values, ComputedStyle style)
+      : node_(node), style_values_(std::move(style_values)), style_(style){};
   dom::Node &get_node() const { return node_; }
-  std::vector<std::reference_wrapper<StyledNode>> get_children() const {
-    std::vector<std::reference_wrapper<StyledNode>> children;
-    for (auto const &child : children_) {
-      children.push_back(*child);
-    }
-    return children;
-  };
   void log() const;
-  DisplayType get_display_type() const;
+  DisplayType get_display_type() const { return style_.display; }
   std::string get_tag() const;
-  PropertyMap get_style_values() const { return style_values_; };
+  const PropertyMap &get_style_values() const { return style_values_; };
+  const ComputedStyle &get_style() const { return style_; }
 };
 
+// Counters describing how much selector matching work styling has done.
+struct MatchStats {
+  long elements = 0;
+  long rules_probed = 0;
+  double probedPerElement() const {
+    return elements == 0 ? 0 : (double)rules_probed / elements;
+  }
+};
+
+const MatchStats &getMatchStats();
+void resetMatchStats();
+
 std::string getValue(const PropertyMap style_value, const std::string &property,
                      const std::string &default_value = constants::DEFAULT);
 
-std::unique_ptr<StyledNode> styleTree(
-    dom::Node &root, const std::unique_ptr<css::StyleSheet const> &css,
-    PropertyMap parentStyles);
+// Resolves a property map into typed styles for a node with the given tag.
+ComputedStyle computeStyle(const PropertyMap &style_values,
+                           const std::string &tag);
+
+// Remembers the styles of recently styled elements so that elements with the
+// same matching inputs (tag, id, classes and parent styles), such as the items
+// of a long list, can reuse them instead of going through selector matching.
+class StyleSharingCache {
+  struct Entry {
+    std::string tag;
+    std::string id;
+    std::string classes;
+    PropertyMap parent_styles;
+    PropertyMap style_values;
+    ComputedStyle style;
+  };
+  // Most recently used first.
+  std::vector<Entry> entries_;
+  bool verify_ = false;
+
+ public:
+  struct Stats {
+    long hits = 0;
+    long misses = 0;
+    long mismatches = 0;
+  };
+  static constexpr int kMaxEntries = 16;
+
+  // If `verify` is set, every cache hit is checked against a full match and
+  // mismatches are reported in the stats.
+  StyleSharingCache(bool verify = false) : verify_(verify){};
+  // Looks up styles for `node`. On a hit, fills `style_values` and `style`.
+  bool find(const dom::ElementNode &node, const PropertyMap &parent_styles,
+            PropertyMap *style_values, ComputedStyle *style);
+  void insert(const dom::ElementNode &node, const PropertyMap &parent_styles,
+              const PropertyMap &style_values, const ComputedStyle &style);
+  bool verifying() const { return verify_; }
+  void recordMismatch() { stats.mismatches++; }
+  Stats stats;
+};
+
+// Builds the styled tree, allocating its nodes in `arena`. If `cache` is
+// provided, it is used to share styles between elements with identical
+// matching inputs.
+StyledNode *styleTree(dom::Node &root,
+                      const std::unique_ptr<css::StyleSheet const> &css,
+                      PropertyMap parentStyles, arena::Arena *arena,
+                      StyleSharingCache *cache = nullptr);
 }  // namespace style
 #endif
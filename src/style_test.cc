@@ -0,0 +1,149 @@
+// Checks that styles shared through the StyleSharingCache are the same as
+// the styles full selector matching gives.
+
+#include "style.h"
+
+#include <string>
+
+#include "absl/strings/str_format.h"
+#include "gtest/gtest.h"
+
+#include "arena.h"
+#include "parse/css.h"
+#include "parse/html.h"
+
+namespace style {
+namespace {
+
+// Long runs of siblings with the same tag and classes, so most elements are
+// cache hits, broken up by ids, compound selectors and changes of parent
+// styles that must not be shared.
+std::string siblingHeavyHtml() {
+  std::string html = "<html><body><div id=\"page\">";
+  for (int list = 0; list < 4; list++) {
+    html += absl::StrFormat("<ul class=\"%s\">",
+                            list % 2 == 0 ? "list" : "list dense");
+    for (int i = 0; i < 40; i++) {
+      std::string attrs = i % 3 == 0 ? "class=\"item\"" : "class=\"item odd\"";
+      if (i % 13 == 0) {
+        attrs += absl::StrFormat(" id=\"item%d\"", i);
+      }
+      html += absl::StrFormat("<li %s>Item <span class=\"label\">%d</span>",
+                              attrs, i);
+      if (i % 7 == 0) {
+        html += "<a class=\"link\">more</a>";
+      }
+      html += "</li>";
+    }
+    html += "</ul><p>Paragraph between lists</p>";
+  }
+  html += "</div></body></html>";
+  return html;
+}
+
+const char kCss[] = R"(
+body { font-size: 16px; color: #253237; font-family: Arial, sans-serif; }
+ul { padding-left: 20px; }
+.dense { font-size: 12px; }
+li { display: block; margin-bottom: 4px; }
+.item { color: #434371; }
+.odd { background-color: #eeeeee; }
+li.odd { font-weight: bold; }
+#item0 { color: #ff0000; }
+#item26 { font-style: italic; }
+.label { color: #4acebd; }
+span { text-decoration: underline; }
+a { display: inline; color: #0000ff; }
+p { margin: 10px; }
+)";
+
+void expectSameStyle(const ComputedStyle &a, const ComputedStyle &b) {
+  EXPECT_EQ(a.display, b.display);
+  EXPECT_EQ(a.width.px, b.width.px);
+  EXPECT_EQ(a.width.is_auto, b.width.is_auto);
+  EXPECT_EQ(a.height.px, b.height.px);
+  EXPECT_EQ(a.height.is_auto, b.height.is_auto);
+  const EdgeLengths *a_edges[] = {&a.margin, &a.padding, &a.border_width};
+  const EdgeLengths *b_edges[] = {&b.margin, &b.padding, &b.border_width};
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(a_edges[i]->top.px, b_edges[i]->top.px);
+    EXPECT_EQ(a_edges[i]->right.px, b_edges[i]->right.px);
+    EXPECT_EQ(a_edges[i]->bottom.px, b_edges[i]->bottom.px);
+    EXPECT_EQ(a_edges[i]->left.px, b_edges[i]->left.px);
+    EXPECT_EQ(a_edges[i]->left.is_auto, b_edges[i]->left.is_auto);
+    EXPECT_EQ(a_edges[i]->right.is_auto, b_edges[i]->right.is_auto);
+  }
+  EXPECT_EQ(a.border_radius, b.border_radius);
+  EXPECT_EQ(a.font_size, b.font_size);
+  EXPECT_EQ(a.font_family, b.font_family);
+  EXPECT_EQ(a.line_height, b.line_height);
+  EXPECT_EQ(a.bold, b.bold);
+  EXPECT_EQ(a.italic, b.italic);
+  EXPECT_EQ(a.underline, b.underline);
+  EXPECT_EQ(a.color, b.color);
+  EXPECT_EQ(a.background_color, b.background_color);
+  EXPECT_EQ(a.border_color, b.border_color);
+}
+
+// Walks two styled trees of the same document in step. Returns the number of
+// nodes compared.
+int expectSameTree(const StyledNode &expected, const StyledNode &actual) {
+  EXPECT_EQ(&expected.get_node(), &actual.get_node());
+  EXPECT_EQ(expected.get_style_values(), actual.get_style_values())
+      << expected.get_node().toLogStr();
+  expectSameStyle(expected.get_style(), actual.get_style());
+  int nodes = 1;
+  auto expected_children = expected.get_children();
+  auto actual_children = actual.get_children();
+  auto e = expected_children.begin();
+  auto a = actual_children.begin();
+  for (; e != expected_children.end() && a != actual_children.end();
+       ++e, ++a) {
+    nodes += expectSameTree(*e, *a);
+  }
+  EXPECT_TRUE(e == expected_children.end() && a == actual_children.end())
+      << "Different numbers of children under "
+      << expected.get_node().toLogStr();
+  return nodes;
+}
+
+class StyleSharingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    html_ = siblingHeavyHtml();
+    html_parser::HtmlParser parser(0, html_, &arena_);
+    root_ = parser.parseNodes(nullptr);
+    ASSERT_NE(root_, nullptr);
+    css_ = css::parseCss(kCss);
+  }
+
+  StyledNode *styleDocument(StyleSharingCache *cache) {
+    return styleTree(*root_, css_, PropertyMap(), &arena_, cache);
+  }
+
+  std::string html_;
+  arena::Arena arena_;
+  dom::Node *root_ = nullptr;
+  std::unique_ptr<css::StyleSheet const> css_;
+};
+
+TEST_F(StyleSharingTest, SharedStylesMatchFullMatching) {
+  StyledNode *matched = styleDocument(nullptr);
+  StyleSharingCache cache;
+  StyledNode *shared = styleDocument(&cache);
+  EXPECT_GT(expectSameTree(*matched, *shared), 400);
+  // The document is built so that most elements can share.
+  EXPECT_GT(cache.stats.hits, cache.stats.misses);
+}
+
+TEST_F(StyleSharingTest, VerifyingFindsNoMismatches) {
+  StyledNode *matched = styleDocument(nullptr);
+  StyleSharingCache cache(/*verify=*/true);
+  StyledNode *verified = styleDocument(&cache);
+  expectSameTree(*matched, *verified);
+  EXPECT_GT(cache.stats.hits, 0);
+  EXPECT_EQ(cache.stats.mismatches, 0);
+}
+
+}  // namespace
+}  // namespace style
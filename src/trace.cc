@@ -0,0 +1,128 @@
+#include "trace.h"
+
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "absl/strings/str_format.h"
+
+#include "util.h"
+
+namespace trace {
+
+namespace internal {
+std::atomic<bool> enabled(false);
+}  // namespace internal
+
+namespace {
+
+struct Event {
+  const char* name;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+};
+
+// Spans recorded on one thread. Only that thread appends to it, so recording
+// takes no lock.
+struct ThreadBuffer {
+  int tid;
+  std::string name;
+  std::vector<Event> events;
+};
+
+std::chrono::steady_clock::time_point trace_start;
+// Every thread's buffer, kept after the thread exits so its spans can still
+// be written.
+std::mutex buffers_mutex;
+std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+ThreadBuffer* getThreadBuffer() {
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffers.emplace_back(new ThreadBuffer);
+    buffer = buffers.back().get();
+    buffer->tid = buffers.size();
+    buffer->events.reserve(4096);
+  }
+  return buffer;
+}
+
+double micros(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+// Escapes a string for a JSON string literal.
+std::string escape(const std::string& s) {
+  std::string escaped;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += absl::StrFormat("\\u%04x", c);
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+}  // namespace
+
+void internal::record(const char* name,
+                      std::chrono::steady_clock::time_point start,
+                      std::chrono::steady_clock::time_point end) {
+  getThreadBuffer()->events.push_back(Event{name, start, end});
+}
+
+void enable() {
+  trace_start = std::chrono::steady_clock::now();
+  internal::enabled.store(true, std::memory_order_relaxed);
+}
+
+void setThreadName(const std::string& name) {
+  if (isEnabled()) {
+    getThreadBuffer()->name = name;
+  }
+}
+
+bool write(const std::string& path) {
+  std::ofstream out(path);
+  std::lock_guard<std::mutex> lock(buffers_mutex);
+  long events = 0;
+  out << "{\"traceEvents\": [\n";
+  bool first = true;
+  for (const std::unique_ptr<ThreadBuffer>& buffer : buffers) {
+    if (!buffer->name.empty()) {
+      out << (first ? "" : ",\n")
+          << absl::StrFormat(
+                 "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                 "\"tid\": %d, \"args\": {\"name\": \"%s\"}}",
+                 buffer->tid, escape(buffer->name));
+      first = false;
+    }
+    // Complete events, each with its start and duration.
+    for (const Event& event : buffer->events) {
+      out << (first ? "" : ",\n")
+          << absl::StrFormat(
+                 "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                 "\"ts\": %.3f, \"dur\": %.3f}",
+                 escape(event.name), buffer->tid,
+                 micros(event.start - trace_start),
+                 micros(event.end - event.start));
+      first = false;
+      events++;
+    }
+  }
+  out << "\n]}\n";
+  if (!out) {
+    logger::error("Unable to write trace to " + path);
+    return false;
+  }
+  logger::info(absl::StrFormat("Wrote %d trace events to %s", events, path));
+  return true;
+}
+
+}  // namespace trace
@@ -0,0 +1,63 @@
+// Scoped timing spans, written out in the Chrome Trace Event format so a page
+// load can be inspected in chrome://tracing or Perfetto.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace trace {
+
+namespace internal {
+extern std::atomic<bool> enabled;
+// Records a finished span in the calling thread's buffer.
+void record(const char* name, std::chrono::steady_clock::time_point start,
+            std::chrono::steady_clock::time_point end);
+}  // namespace internal
+
+// Starts recording spans. Spans are dropped until this is called.
+void enable();
+inline bool isEnabled() {
+  return internal::enabled.load(std::memory_order_relaxed);
+}
+// Names the calling thread in the trace, if tracing is on.
+void setThreadName(const std::string& name);
+// Writes every span recorded so far as Chrome trace JSON. Threads that record
+// spans must be idle while this runs. Returns false if the file can't be
+// written.
+bool write(const std::string& path);
+
+// Records the time from its construction to its destruction as a span. When
+// tracing is off this costs a relaxed load of one flag. `name` must outlive
+// the trace, so it is normally a string literal.
+class Span {
+  const char* name_;
+  std::chrono::steady_clock::time_point start_;
+  bool active_;
+
+ public:
+  explicit Span(const char* name) : name_(name), active_(isEnabled()) {
+    if (active_) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~Span() {
+    if (active_) {
+      internal::record(name_, start_, std::chrono::steady_clock::now());
+    }
+  }
+  Span(const Span&) = delete;
+  Span& operator=(const Span&) = delete;
+};
+
+}  // namespace trace
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces the rest of the enclosing scope as a span called `name`.
+#define TRACE_SPAN(name) \
+  ::trace::Span TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+#endif
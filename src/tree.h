@@ -0,0 +1,71 @@
+// Intrusive child links for tree nodes allocated in an arena.
+
+#ifndef TREE_H
+#define TREE_H
+
+#include <cstddef>
+#include <iterator>
+
+namespace tree {
+
+// Base class giving a node first-child/next-sibling links to other nodes of
+// type T. Nodes don't own their children; the arena they live in does.
+template <typename T>
+class TreeNode {
+  T *first_child_ = nullptr;
+  T *last_child_ = nullptr;
+  T *next_sibling_ = nullptr;
+
+ public:
+  class Iterator {
+    T *node_;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T *;
+    using reference = T &;
+
+    Iterator(T *node) : node_(node){};
+    T &operator*() const { return *node_; }
+    T *operator->() const { return node_; }
+    Iterator &operator++() {
+      node_ = node_->next_sibling();
+      return *this;
+    }
+    bool operator==(const Iterator &other) const {
+      return node_ == other.node_;
+    }
+    bool operator!=(const Iterator &other) const {
+      return node_ != other.node_;
+    }
+  };
+
+  // Iterable view over a node's children.
+  class Children {
+    T *first_;
+
+   public:
+    Children(T *first) : first_(first){};
+    Iterator begin() const { return Iterator(first_); }
+    Iterator end() const { return Iterator(nullptr); }
+    bool empty() const { return first_ == nullptr; }
+  };
+
+  Children get_children() const { return Children(first_child_); }
+  T *first_child() const { return first_child_; }
+  T *next_sibling() const { return next_sibling_; }
+
+  void appendChild(T *child) {
+    if (last_child_ == nullptr) {
+      first_child_ = child;
+    } else {
+      last_child_->next_sibling_ = child;
+    }
+    last_child_ = child;
+  }
+};
+}  // namespace tree
+
+#endif
@@ -0,0 +1,226 @@
+#include "util.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+
+namespace logger {
+
+namespace internal {
+std::atomic<int> min_level(static_cast<int>(Level::Info));
+}  // namespace internal
+
+namespace {
+
+const char* levelName(Level level) {
+  switch (level) {
+    case Level::Debug:
+      return "DEBUG";
+    case Level::Info:
+      return "INFO";
+    case Level::Warn:
+      return "WARN";
+    case Level::Error:
+      return "ERROR";
+  }
+  return "";
+}
+
+// A bounded multi-producer, single-consumer queue of messages. Each slot's
+// sequence number says whose turn it is: a producer may fill slot i when it
+// equals the producer's ticket, and the consumer may empty it once it is one
+// more than that. Producers claim tickets with a compare-and-swap, so no
+// thread ever blocks on another.
+class RingBuffer {
+  struct Slot {
+    std::atomic<std::size_t> sequence;
+    std::string message;
+  };
+  std::unique_ptr<Slot[]> slots_;
+  std::size_t mask_;
+  std::atomic<std::size_t> tail_;
+  // Only the consumer reads or writes the head.
+  std::size_t head_ = 0;
+
+ public:
+  explicit RingBuffer(std::size_t capacity) : tail_(0) {
+    std::size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    slots_.reset(new Slot[size]);
+    for (std::size_t i = 0; i < size; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    mask_ = size - 1;
+  }
+
+  // Returns false, leaving `message` alone, if the buffer is full.
+  bool push(std::string* message) {
+    std::size_t ticket = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[ticket & mask_];
+      std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      if (sequence == ticket) {
+        if (tail_.compare_exchange_weak(ticket, ticket + 1,
+                                        std::memory_order_relaxed)) {
+          slot.message.swap(*message);
+          slot.sequence.store(ticket + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (sequence < ticket) {
+        // The consumer hasn't emptied the slot from the last lap yet.
+        return false;
+      } else {
+        ticket = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Appends the next message and a newline to `out`. Returns false if the
+  // buffer is empty.
+  bool pop(std::string* out) {
+    Slot& slot = slots_[head_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) {
+      return false;
+    }
+    out->append(slot.message);
+    out->push_back('\n');
+    slot.message.clear();
+    slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+    head_++;
+    return true;
+  }
+};
+
+// Drains the ring buffer to stdout on a background thread.
+class AsyncWriter {
+  RingBuffer buffer_;
+  std::atomic<bool> stopping_;
+  std::atomic<long> dropped_;
+  // Only used to cut the writer's wait short when it is stopped.
+  std::mutex stop_mutex_;
+  std::condition_variable stopped_;
+  std::thread thread_;
+
+  // Writes everything buffered. Returns false if there was nothing.
+  bool drain() {
+    std::string out;
+    while (buffer_.pop(&out)) {
+    }
+    if (out.empty()) {
+      return false;
+    }
+    std::cout << out << std::flush;
+    return true;
+  }
+
+  void work() {
+    // Producers never wait on the writer, so they don't wake it; it polls
+    // instead. The wait doubles each time there is nothing to write, so an
+    // idle process wakes only a few times a second, and goes back to the
+    // shortest once messages turn up. Stopping ends the wait at once.
+    const std::chrono::milliseconds kMinWait(1);
+    const std::chrono::milliseconds kMaxWait(64);
+    std::chrono::milliseconds wait = kMinWait;
+    while (!stopping_.load(std::memory_order_acquire)) {
+      if (drain()) {
+        wait = kMinWait;
+      } else {
+        std::unique_lock<std::mutex> lock(stop_mutex_);
+        stopped_.wait_for(lock, wait, [this]() {
+          return stopping_.load(std::memory_order_acquire);
+        });
+        wait = std::min(wait * 2, kMaxWait);
+      }
+    }
+    drain();
+  }
+
+ public:
+  explicit AsyncWriter(std::size_t capacity)
+      : buffer_(capacity), stopping_(false), dropped_(0) {
+    thread_ = std::thread(&AsyncWriter::work, this);
+  }
+  ~AsyncWriter() {
+    {
+      std::lock_guard<std::mutex> lock(stop_mutex_);
+      stopping_.store(true, std::memory_order_release);
+    }
+    stopped_.notify_one();
+    thread_.join();
+  }
+
+  void push(std::string message) {
+    if (!buffer_.push(&message)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  long get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+};
+
+std::atomic<AsyncWriter*> async_writer(nullptr);
+
+}  // namespace
+
+void setLevel(Level level) {
+  internal::min_level.store(static_cast<int>(level),
+                            std::memory_order_relaxed);
+}
+
+bool parseLevel(absl::string_view name, Level* level) {
+  const Level levels[] = {Level::Debug, Level::Info, Level::Warn,
+                          Level::Error};
+  for (Level l : levels) {
+    if (absl::EqualsIgnoreCase(name, levelName(l))) {
+      *level = l;
+      return true;
+    }
+  }
+  return false;
+}
+
+void startAsync(std::size_t capacity) {
+  if (async_writer.load() == nullptr) {
+    async_writer.store(new AsyncWriter(capacity));
+  }
+}
+
+void stopAsync() {
+  std::unique_ptr<AsyncWriter> writer(async_writer.exchange(nullptr));
+  if (writer == nullptr) {
+    return;
+  }
+  long dropped = writer->get_dropped();
+  // Joins the writer thread once it has written everything buffered.
+  writer.reset();
+  if (dropped > 0) {
+    warn(absl::StrFormat("Dropped %d log messages with a full buffer",
+                         dropped));
+  }
+}
+
+void log(Level level, absl::string_view message) {
+  if (!isEnabled(level)) {
+    return;
+  }
+  AsyncWriter* writer = async_writer.load(std::memory_order_acquire);
+  if (writer != nullptr) {
+    writer->push(absl::StrCat(levelName(level), ": ", message));
+    return;
+  }
+  std::cout << levelName(level) << ": " << message << '\n';
+  // Make sure errors are seen even if the process then dies.
+  if (level == Level::Error) {
+    std::cout << std::flush;
+  }
+}
+
+}  // namespace logger
@@ -3,55 +3,161 @@
 #ifndef B_UTIL_H
 #define B_UTIL_H
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
+#include "absl/strings/string_view.h"
+
+// Levels below LOG_MIN_LEVEL are compiled out: their LOG_* statements become
+// dead code, and their arguments are never evaluated. Build with e.g.
+// -DLOG_MIN_LEVEL=2 to keep only warnings and errors.
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
 namespace logger {
 
-inline void log(std::vector<std::string> strings,
-                std::string prefix = "DEBUG") {
-  std::cout << prefix << ": ";
-  for (auto s : strings) {
-    std::cout << s << ", ";
+enum class Level { Debug, Info, Warn, Error };
+
+namespace internal {
+extern std::atomic<int> min_level;
+}  // namespace internal
+
+// Whether messages at `level` are written, given both the compile-time and the
+// runtime minimum level. Costs one relaxed load when the level is compiled in.
+inline bool isEnabled(Level level) {
+  return static_cast<int>(level) >= LOG_MIN_LEVEL &&
+         static_cast<int>(level) >=
+             internal::min_level.load(std::memory_order_relaxed);
+}
+
+// Sets the runtime minimum level, which defaults to Info.
+void setLevel(Level level);
+// Parses "debug", "info", "warn" or "error". Returns false for anything else.
+bool parseLevel(absl::string_view name, Level* level);
+
+// Starts a background thread that writes log messages, so that logging only
+// costs a move into a lock-free ring buffer of `capacity` messages (rounded up
+// to a power of two). Messages logged while the buffer is full are dropped.
+void startAsync(std::size_t capacity = 4096);
+// Writes out the messages still buffered and stops the background thread. No
+// other thread may log while this runs.
+void stopAsync();
+
+// Writes `message` if `level` is enabled. Prefer the LOG_* macros when the
+// message is expensive to build, since the arguments here are always
+// evaluated.
+void log(Level level, absl::string_view message);
+
+inline void log(Level level, const std::vector<std::string>& strings) {
+  if (isEnabled(level)) {
+    std::string message;
+    for (const std::string& s : strings) {
+      message += s + ", ";
+    }
+    log(level, message);
   }
-  std::cout << std::endl;
 }
 
-inline void log(std::string string, std::string prefix = "DEBUG") {
-  std::cout << prefix << ": " << string << std::endl;
+inline void debug(std::vector<std::string> strings) {
+  log(Level::Debug, strings);
 }
-inline void debug(std::vector<std::string> strings) { log(strings, "DEBUG"); }
 
-inline void debug(std::string string) { log(string, "DEBUG"); }
-inline void info(std::vector<std::string> strings) { log(strings, "INFO"); }
+inline void debug(absl::string_view string) { log(Level::Debug, string); }
+inline void info(std::vector<std::string> strings) {
+  log(Level::Info, strings);
+}
 
-inline void info(std::string string) { log(string, "INFO"); }
+inline void info(absl::string_view string) { log(Level::Info, string); }
 
-inline void warn(std::vector<std::string> strings) { log(strings, "WARN"); }
+inline void warn(std::vector<std::string> strings) {
+  log(Level::Warn, strings);
+}
 
-inline void warn(std::string string) { log(string, "WARN"); }
-inline void error(std::vector<std::string> strings) { log(strings, "ERROR"); }
+inline void warn(absl::string_view string) { log(Level::Warn, string); }
+inline void error(std::vector<std::string> strings) {
+  log(Level::Error, strings);
+}
 
-inline void error(std::string string) { log(string, "ERROR"); }
+inline void error(absl::string_view string) { log(Level::Error, string); }
 
 }  // namespace logger
 
+// Logs `message` at `level`, evaluating `message` only if the level is
+// enabled, so formatting costs nothing for disabled levels. Safe to use as
+// the body of an unbraced if.
+#define LOG_AT(level, message)            \
+  if (!::logger::isEnabled(level)) {      \
+  } else                                  \
+    ::logger::log(level, message)
+#define LOG_DEBUG(message) LOG_AT(::logger::Level::Debug, message)
+#define LOG_INFO(message) LOG_AT(::logger::Level::Info, message)
+
 namespace io {
 inline std::string readFile(const std::string& filename) {
-  std::string file_contents;
-  std::string line;
+  std::ostringstream file_contents;
   std::ifstream f(filename);
   if (f.is_open()) {
-    while (getline(f, line)) {
-      file_contents += line;
-    }
+    file_contents << f.rdbuf();
     f.close();
   } else {
     logger::error("Unable to open file: " + filename);
   }
-  return file_contents;
+  return file_contents.str();
+}
+
+// A read-only memory mapping of a file. Parsers slice their tokens out of the
+// mapping rather than copying the file, so it must outlive anything parsed
+// from it. A file that can't be opened or mapped has empty contents.
+class MappedFile {
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+
+ public:
+  explicit MappedFile(const std::string& filename);
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      munmap(const_cast<char*>(data_), size_);
+    }
+  }
+  MappedFile(const MappedFile& file) = delete;
+  MappedFile& operator=(const MappedFile& file) = delete;
+
+  absl::string_view get_contents() const {
+    return absl::string_view(data_, size_);
+  }
+};
+
+inline MappedFile::MappedFile(const std::string& filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    logger::error("Unable to open file: " + filename);
+    return;
+  }
+  struct stat file_stat;
+  // Empty files can't be mapped; they just have empty contents.
+  if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+    void* data =
+        mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      logger::error("Unable to map file: " + filename);
+    } else {
+      // Parsers read front to back, so let the kernel read ahead.
+      madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(data);
+      size_ = file_stat.st_size;
+    }
+  }
+  close(fd);
 }
 }  // namespace io
 